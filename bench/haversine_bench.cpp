@@ -0,0 +1,74 @@
+// Throughput of the batch Haversine kernels (haversine_batch.cpp) against ReferenceHaversine.
+// Runs Count random pairs (uniform over the globe) through the reference loop and through the
+// batch kernel at every ISA the CPU supports, best of 5 runs each, and reports pairs per second
+// and the largest relative difference from the reference distances.
+//
+// g++ -O2 -o haversine_bench bench/haversine_bench.cpp
+// ./haversine_bench [count]
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "../haversine_formula.cpp"
+#include "../haversine_batch.cpp"
+#include "../timer.cpp"
+
+static void Report(char const *Name, u64 Best, size_t Count, double Sum, double MaxError, u64 CPUFreq) {
+    double Seconds = (double)Best / (double)CPUFreq;
+    printf("  %-10s %8.1f M pairs/s %7.2f ns/pair  sum %.6f  max relative error %.3g\n", Name,
+           (double)Count / Seconds / 1e6, 1e9 * Seconds / (double)Count, Sum, MaxError);
+}
+
+int main(int ArgCount, char **Args) {
+    size_t Count = (ArgCount == 2) ? (size_t)atoll(Args[1]) : 1000000;
+    u64 CPUFreq = EstimateCPUTimerFreq();
+    double EarthRadius = 6372.8;
+
+    std::vector<double> X0(Count), Y0(Count), X1(Count), Y1(Count), Reference(Count), Distances(Count);
+    std::mt19937_64 Random(1234);
+    std::uniform_real_distribution<double> Longitude(-180.0, 180.0), Latitude(-90.0, 90.0);
+    for (size_t Index = 0; Index < Count; ++Index){
+        X0[Index] = Longitude(Random);
+        Y0[Index] = Latitude(Random);
+        X1[Index] = Longitude(Random);
+        Y1[Index] = Latitude(Random);
+    }
+
+    printf("%zu pairs:\n", Count);
+    u64 Best = ~0ULL;
+    double Sum = 0;
+    for (int Repeat = 0; Repeat < 5; ++Repeat){
+        u64 Begin = ReadCPUTimer();
+        Sum = 0;
+        for (size_t Index = 0; Index < Count; ++Index){
+            Reference[Index] = ReferenceHaversine(X0[Index], Y0[Index], X1[Index], Y1[Index], EarthRadius);
+            Sum += Reference[Index];
+        }
+        u64 Elapsed = ReadCPUTimer() - Begin;
+        if (Elapsed < Best) Best = Elapsed;
+    }
+    Report("reference", Best, Count, Sum, 0, CPUFreq);
+
+    for (int ISA = HaversineISA_Scalar; ISA < HaversineISA_Count; ++ISA){
+        if (!HaversineISASupported((haversine_isa)ISA)){
+            printf("  %-10s not supported by this CPU\n", HaversineISAName((haversine_isa)ISA));
+            continue;
+        }
+        Best = ~0ULL;
+        for (int Repeat = 0; Repeat < 5; ++Repeat){
+            u64 Begin = ReadCPUTimer();
+            Sum = HaversineBatch((haversine_isa)ISA, X0.data(), Y0.data(), X1.data(), Y1.data(), Count, EarthRadius, Distances.data());
+            u64 Elapsed = ReadCPUTimer() - Begin;
+            if (Elapsed < Best) Best = Elapsed;
+        }
+        double MaxError = 0;
+        for (size_t Index = 0; Index < Count; ++Index){
+            double Error = fabs(Distances[Index] - Reference[Index]) / (Reference[Index] > 0 ? Reference[Index] : 1.0);
+            if (Error > MaxError) MaxError = Error;
+        }
+        Report(HaversineISAName((haversine_isa)ISA), Best, Count, Sum, MaxError, CPUFreq);
+    }
+    printf("Best supported: %s\n", HaversineISAName(BestHaversineISA()));
+    return 0;
+}
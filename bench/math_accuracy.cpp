@@ -0,0 +1,225 @@
+// Accuracy of the approximations in haversine_batch.cpp, to see how far they can be cut down.
+// 1. Sweeps each function over the domain the Haversine kernel uses it on (evenly spaced samples,
+//    both ends included) at every ISA the CPU supports, and reports the max and mean error in
+//    ULPs against libm, with the input where the max occurs.
+// 2. Given a pair file and the haveranswer file of the same generator run (--binary writes both),
+//    compares every distance of ReferenceHaversine and of the batch kernel, and their totals,
+//    with the generator's answers.
+//
+// g++ -O2 -o math_accuracy bench/math_accuracy.cpp
+// ./math_accuracy [samples] [data_N_pairs.bin data_N_haveranswer.json]
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "../haversine_formula.cpp"
+#include "../haversine_batch.cpp"
+#include "../pair_file.cpp"
+
+enum math_function {
+    MathFunction_Sin,
+    MathFunction_Cos,
+    MathFunction_ArcSine,
+    MathFunction_SquareRoot,
+
+    MathFunction_Count,
+};
+
+struct math_domain {
+    char const *Name;
+    double Min;
+    double Max;
+    double (*Reference)(double);
+};
+
+// sin gets half the longitude difference, cos a latitude, asin and sqrt the haversine a
+static math_domain const Domains[MathFunction_Count] = {
+    {"sin", -M_PI, M_PI, sin},
+    {"cos", -M_PI/2, M_PI/2, cos},
+    {"asin", 0.0, 1.0, asin},
+    {"sqrt", 0.0, 1.0, sqrt},
+};
+
+template <typename V, typename I>
+HAVERSINE_INLINE void EvaluateLanes(math_function Function, double const *Input, double *Output, size_t Count){
+    enum { Width = sizeof(V) / sizeof(double) };
+    for (size_t Index = 0; Index < Count; Index += Width){
+        // The last step reads (and writes) past Count, the buffers are padded for it
+        V X, Y;
+        Load(Input + Index, &X);
+        switch (Function){
+            case MathFunction_Sin: Sine<V, I>(X, 0, &Y); break;
+            case MathFunction_Cos: Sine<V, I>(X, 1, &Y); break;
+            case MathFunction_ArcSine: ArcSine<V, I>(X, &Y); break;
+            default: SquareRoot<V, I>(X, &Y); break;
+        }
+        memcpy(Output + Index, &Y, sizeof(Y));
+    }
+}
+
+__attribute__((target("avx512f,avx2,fma")))
+static void EvaluateAVX512(math_function Function, double const *Input, double *Output, size_t Count){
+    EvaluateLanes<f64x8, s64x8>(Function, Input, Output, Count);
+}
+
+__attribute__((target("avx2,fma")))
+static void EvaluateAVX2(math_function Function, double const *Input, double *Output, size_t Count){
+    EvaluateLanes<f64x4, s64x4>(Function, Input, Output, Count);
+}
+
+static void EvaluateScalar(math_function Function, double const *Input, double *Output, size_t Count){
+    EvaluateLanes<f64x1, s64x1>(Function, Input, Output, Count);
+}
+
+// Doubles mapped to integers that are consecutive for consecutive doubles (-0 and +0 are both 0)
+static int64_t OrderedBits(double Value){
+    int64_t Bits;
+    memcpy(&Bits, &Value, sizeof(Bits));
+    int64_t Result = (Bits < 0) ? (int64_t)(0x8000000000000000ULL - (uint64_t)Bits) : Bits;
+    return Result;
+}
+
+static double UlpDistance(double A, double B){
+    int64_t Difference = OrderedBits(A) - OrderedBits(B);
+    double Result = (double)((Difference < 0) ? -Difference : Difference);
+    return Result;
+}
+
+static void SweepFunctions(size_t SampleCount){
+    printf("Function sweeps (%zu samples each, error against libm):\n", SampleCount);
+    std::vector<double> Input(SampleCount + 8, 0.0), Output(SampleCount + 8), Reference(SampleCount);
+
+    for (int Function = 0; Function < MathFunction_Count; ++Function){
+        math_domain const &Domain = Domains[Function];
+        for (size_t Index = 0; Index < SampleCount; ++Index){
+            double T = (SampleCount > 1) ? (double)Index / (double)(SampleCount - 1) : 0.0;
+            Input[Index] = (Index + 1 == SampleCount) ? Domain.Max : Domain.Min + T*(Domain.Max - Domain.Min);
+            Reference[Index] = Domain.Reference(Input[Index]);
+        }
+
+        for (int ISA = HaversineISA_Scalar; ISA < HaversineISA_Count; ++ISA){
+            if (!HaversineISASupported((haversine_isa)ISA)){
+                continue;
+            }
+            switch (ISA){
+                case HaversineISA_AVX512: EvaluateAVX512((math_function)Function, Input.data(), Output.data(), SampleCount); break;
+                case HaversineISA_AVX2: EvaluateAVX2((math_function)Function, Input.data(), Output.data(), SampleCount); break;
+                default: EvaluateScalar((math_function)Function, Input.data(), Output.data(), SampleCount); break;
+            }
+
+            double MaxUlp = 0;
+            double SumUlp = 0;
+            size_t Worst = 0;
+            for (size_t Index = 0; Index < SampleCount; ++Index){
+                double Ulp = UlpDistance(Output[Index], Reference[Index]);
+                SumUlp += Ulp;
+                if (Ulp > MaxUlp){
+                    MaxUlp = Ulp;
+                    Worst = Index;
+                }
+            }
+            printf("  %-5s [%+.4f, %+.4f] %-8s max %6.0f ulp  mean %.4f ulp  worst at x = %.17g (%.17g vs %.17g)\n",
+                   Domain.Name, Domain.Min, Domain.Max, HaversineISAName((haversine_isa)ISA), MaxUlp,
+                   SumUlp / (double)SampleCount, Input[Worst], Output[Worst], Reference[Worst]);
+        }
+    }
+}
+
+static std::vector<char> ReadWholeFile(char const *Path){
+    std::vector<char> Result;
+    FILE *File = fopen(Path, "rb");
+    if (File){
+        char Buffer[1 << 16];
+        size_t Count;
+        while ((Count = fread(Buffer, 1, sizeof(Buffer), File)) > 0){
+            Result.insert(Result.end(), Buffer, Buffer + Count);
+        }
+        fclose(File);
+    }
+    return Result;
+}
+
+static void ReportDistances(char const *Name, double const *Distances, double const *Answers, size_t PairCount, double ExpectedSum){
+    double MaxAbsolute = 0;
+    double MaxRelative = 0;
+    double MaxUlp = 0;
+    double SumUlp = 0;
+    size_t Worst = 0;
+    double Sum = 0;
+    double SumCoef = 1.0 / (double)PairCount;
+    for (size_t Index = 0; Index < PairCount; ++Index){
+        double Absolute = fabs(Distances[Index] - Answers[Index]);
+        double Ulp = UlpDistance(Distances[Index], Answers[Index]);
+        if (Absolute > MaxAbsolute){
+            MaxAbsolute = Absolute;
+            Worst = Index;
+        }
+        if (Answers[Index] > 0 && Absolute / Answers[Index] > MaxRelative){
+            MaxRelative = Absolute / Answers[Index];
+        }
+        if (Ulp > MaxUlp) MaxUlp = Ulp;
+        SumUlp += Ulp;
+        Sum += SumCoef * Distances[Index];
+    }
+    printf("  %-10s max %.3g km (relative %.3g, pair %zu)  max %.0f ulp  mean %.4f ulp  sum %.16f (off by %.3g)\n",
+           Name, MaxAbsolute, MaxRelative, Worst, MaxUlp, SumUlp / (double)PairCount, Sum, Sum - ExpectedSum);
+}
+
+static int CheckAnswers(char const *PairPath, char const *AnswerPath){
+    std::vector<char> Pairs = ReadWholeFile(PairPath);
+    if (char const *Error = CheckPairFile(Pairs.data(), Pairs.size())){
+        fprintf(stderr, "%s: %s\n", PairPath, Error);
+        return 1;
+    }
+    pair_file_header Header;
+    memcpy(&Header, Pairs.data(), sizeof(Header));
+    size_t PairCount = Header.PairCount;
+
+    // One distance per pair, then the sum
+    std::vector<char> AnswerBytes = ReadWholeFile(AnswerPath);
+    if (AnswerBytes.size() != (PairCount + 1)*sizeof(double)){
+        fprintf(stderr, "%s: expected %zu answers for %zu pairs\n", AnswerPath, PairCount + 1, PairCount);
+        return 1;
+    }
+    std::vector<double> Answers(PairCount + 1);
+    memcpy(Answers.data(), AnswerBytes.data(), AnswerBytes.size());
+    double ExpectedSum = Answers[PairCount];
+
+    double const *X0 = PairColumn(Pairs.data(), 0);
+    double const *Y0 = PairColumn(Pairs.data(), 1);
+    double const *X1 = PairColumn(Pairs.data(), 2);
+    double const *Y1 = PairColumn(Pairs.data(), 3);
+    double EarthRadius = 6371.8; // the generator's
+
+    printf("Against %s (%zu pairs, expected sum %.16f):\n", AnswerPath, PairCount, ExpectedSum);
+    std::vector<double> Distances(PairCount);
+    for (size_t Index = 0; Index < PairCount; ++Index){
+        Distances[Index] = ReferenceHaversine(X0[Index], Y0[Index], X1[Index], Y1[Index], EarthRadius);
+    }
+    ReportDistances("reference", Distances.data(), Answers.data(), PairCount, ExpectedSum);
+
+    for (int ISA = HaversineISA_Scalar; ISA < HaversineISA_Count; ++ISA){
+        if (HaversineISASupported((haversine_isa)ISA)){
+            HaversineBatch((haversine_isa)ISA, X0, Y0, X1, Y1, PairCount, EarthRadius, Distances.data());
+            ReportDistances(HaversineISAName((haversine_isa)ISA), Distances.data(), Answers.data(), PairCount, ExpectedSum);
+        }
+    }
+    return 0;
+}
+
+int main(int ArgCount, char **Args) {
+    if (ArgCount != 1 && ArgCount != 2 && ArgCount != 4){
+        fprintf(stderr, "Usage: %s [samples] [data_N_pairs.bin data_N_haveranswer.json]\n", Args[0]);
+        return 1;
+    }
+    size_t SampleCount = (ArgCount >= 2) ? (size_t)atoll(Args[1]) : 10000000;
+    if (SampleCount < 2){
+        SampleCount = 2;
+    }
+
+    SweepFunctions(SampleCount);
+    if (ArgCount == 4){
+        return CheckAnswers(Args[2], Args[3]);
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+// Micro-benchmark for parseJsonNumber against std::stod and std::from_chars.
+// The inputs are formatted the way haversine_point_generator writes them ("%.16f" in [-180, 180]),
+// plus a set of full precision "%.17g" doubles to exercise the Eisel-Lemire path on wider exponents.
+//
+// g++ -O2 -o number_bench bench/number_bench.cpp json/json_number.cpp
+// ./number_bench [count]
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../json/json_number.hpp"
+#include "../timer.cpp"
+
+static u64 RandomState = 0x9E3779B97F4A7C15ULL;
+static u64 NextRandom(void) {
+    // xorshift64*, good enough to make inputs
+    RandomState ^= RandomState >> 12;
+    RandomState ^= RandomState << 25;
+    RandomState ^= RandomState >> 27;
+    return RandomState * 2685821657736338717ULL;
+}
+
+struct bench_input {
+    char const *Label;
+    std::string Text;               // all numbers back to back
+    std::vector<std::string_view> Numbers;
+};
+
+static void BuildInput(bench_input &Input, size_t Count, bool Coordinates) {
+    std::vector<size_t> Offsets;
+    char Temp[64];
+    for (size_t Index = 0; Index < Count; ++Index){
+        double Value;
+        if (Coordinates){
+            Value = -180.0 + 360.0 * ((double)NextRandom() / (double)UINT64_MAX);
+            snprintf(Temp, sizeof(Temp), "%.16f", Value);
+        } else {
+            u64 Bits;
+            do { Bits = NextRandom(); memcpy(&Value, &Bits, sizeof(Value)); } while (!std::isnormal(Value));
+            snprintf(Temp, sizeof(Temp), "%.17g", Value);
+        }
+        Offsets.push_back(Input.Text.size());
+        Input.Text += Temp;
+    }
+    Offsets.push_back(Input.Text.size());
+    for (size_t Index = 0; Index < Count; ++Index){
+        Input.Numbers.emplace_back(Input.Text.data() + Offsets[Index], Offsets[Index + 1] - Offsets[Index]);
+    }
+}
+
+template <typename F>
+static double Run(bench_input &Input, std::vector<double> &Out, F &&Convert, u64 CPUFreq, char const *Name) {
+    u64 Best = ~0ULL;
+    for (int Repeat = 0; Repeat < 5; ++Repeat){
+        u64 Begin = ReadCPUTimer();
+        for (size_t Index = 0; Index < Input.Numbers.size(); ++Index){
+            Out[Index] = Convert(Input.Numbers[Index]);
+        }
+        u64 Elapsed = ReadCPUTimer() - Begin;
+        if (Elapsed < Best) Best = Elapsed;
+    }
+    double Seconds = (double)Best / (double)CPUFreq;
+    printf("  %-16s %8.2f ns/number %8.1f MB/s\n", Name, 1e9 * Seconds / (double)Input.Numbers.size(),
+           (double)Input.Text.size() / Seconds / 1e6);
+    return Seconds;
+}
+
+int main(int ArgCount, char **Args) {
+    size_t Count = (ArgCount == 2) ? (size_t)atoll(Args[1]) : 1000000;
+    u64 CPUFreq = EstimateCPUTimerFreq();
+
+    bench_input Inputs[2] = {{"%.16f coordinates", {}, {}}, {"%.17g doubles", {}, {}}};
+    BuildInput(Inputs[0], Count, true);
+    BuildInput(Inputs[1], Count, false);
+
+    for (bench_input &Input : Inputs){
+        std::vector<double> Stod(Count), FromChars(Count), Fast(Count);
+        printf("%s (%zu numbers):\n", Input.Label, Count);
+        Run(Input, Stod, [](std::string_view Text) { return std::stod(std::string(Text)); }, CPUFreq, "std::stod");
+        Run(Input, FromChars, [](std::string_view Text) {
+            double Value = 0;
+            std::from_chars(Text.data(), Text.data() + Text.size(), Value);
+            return Value;
+        }, CPUFreq, "std::from_chars");
+        Run(Input, Fast, [](std::string_view Text) { return parseJsonNumber(Text); }, CPUFreq, "parseJsonNumber");
+
+        size_t Mismatches = 0;
+        for (size_t Index = 0; Index < Count; ++Index){
+            if (memcmp(&Stod[Index], &Fast[Index], sizeof(double)) || memcmp(&FromChars[Index], &Fast[Index], sizeof(double))){
+                ++Mismatches;
+            }
+        }
+        printf("  mismatches against std::stod/std::from_chars: %zu\n", Mismatches);
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+// Micro-benchmark for JsonObject against the std::map<std::string, JsonValue> it replaced.
+// Builds Count objects shaped like the generator's pairs ({"x0","y0","x1","y1"}) and Count/8
+// wider objects (32 keys, above HASH_THRESHOLD), then reports the heap bytes each object keeps
+// alive (tracked by replacing operator new/delete) and the latency of at() with every key.
+//
+// g++ -O2 -o object_bench bench/object_bench.cpp json/json_object.cpp json/json_parser.cpp json/json_structural.cpp json/json_number.cpp
+// ./object_bench [count]
+#include <cstdio>
+#include <cstdlib>
+#include <malloc.h>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+#include "../json/json_parser.hpp"
+#include "../timer.cpp"
+
+// Live heap bytes, as the allocator sees them (including its rounding up)
+static size_t AllocatedBytes = 0;
+
+// Every form of new/delete goes through these two. They are kept out of line, GCC otherwise
+// inlines free() into delete expressions and warns that it does not match the new beside it.
+__attribute__((noinline)) void *operator new(size_t Size) {
+    if (void *Memory = malloc(Size)){
+        AllocatedBytes += malloc_usable_size(Memory);
+        return Memory;
+    }
+    throw std::bad_alloc();
+}
+__attribute__((noinline)) void operator delete(void *Memory) noexcept {
+    if (Memory){
+        AllocatedBytes -= malloc_usable_size(Memory);
+        free(Memory);
+    }
+}
+void operator delete(void *Memory, size_t) noexcept { operator delete(Memory); }
+void *operator new[](size_t Size) { return operator new(Size); }
+void operator delete[](void *Memory) noexcept { operator delete(Memory); }
+void operator delete[](void *Memory, size_t) noexcept { operator delete(Memory); }
+
+using map_object = std::map<std::string, JsonValue>;
+
+template <typename Object>
+static void Run(char const *Name, std::vector<std::string> const &Keys, size_t Count, u64 CPUFreq) {
+    size_t Before = AllocatedBytes;
+    std::vector<Object> Objects(Count);
+    for (size_t Index = 0; Index < Count; ++Index){
+        for (size_t Key = 0; Key < Keys.size(); ++Key){
+            Objects[Index][Keys[Key]] = JsonValue((double)(Index + Key));
+        }
+    }
+    size_t Bytes = AllocatedBytes - Before;
+
+    u64 Best = ~0ULL;
+    double Check = 0;
+    for (int Repeat = 0; Repeat < 5; ++Repeat){
+        u64 Begin = ReadCPUTimer();
+        double Sum = 0;
+        for (Object const &Entry : Objects){
+            for (std::string const &Key : Keys){
+                Sum += Entry.at(Key).asNumber();
+            }
+        }
+        u64 Elapsed = ReadCPUTimer() - Begin;
+        if (Elapsed < Best) Best = Elapsed;
+        Check = Sum;
+    }
+    double Lookups = (double)(Count * Keys.size());
+    printf("  %-34s %8.1f bytes/object %8.2f ns/lookup (checksum %.0f)\n", Name,
+           (double)Bytes / (double)Count, 1e9 * (double)Best / (double)CPUFreq / Lookups, Check);
+}
+
+int main(int ArgCount, char **Args) {
+    size_t Count = (ArgCount == 2) ? (size_t)atoll(Args[1]) : 1000000;
+    u64 CPUFreq = EstimateCPUTimerFreq();
+
+    std::vector<std::string> PairKeys = {"x0", "y0", "x1", "y1"};
+    std::vector<std::string> WideKeys;
+    for (int Key = 0; Key < 32; ++Key){
+        WideKeys.push_back("field_" + std::to_string(Key));
+    }
+
+    printf("4 keys (%zu objects):\n", Count);
+    Run<map_object>("std::map<std::string, JsonValue>", PairKeys, Count, CPUFreq);
+    Run<JsonObject>("JsonObject", PairKeys, Count, CPUFreq);
+    printf("32 keys (%zu objects):\n", Count / 8);
+    Run<map_object>("std::map<std::string, JsonValue>", WideKeys, Count / 8, CPUFreq);
+    Run<JsonObject>("JsonObject", WideKeys, Count / 8, CPUFreq);
+    return 0;
+}
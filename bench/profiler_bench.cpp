@@ -0,0 +1,79 @@
+// Cost of a PROFILE_SCOPE (profiler/Profiler.h) when many threads record at once.
+// First a whole session of 20*Count scopes on one thread: the time per scope while it runs, how
+// long ending the session (writing its trace) takes, and the peak memory.
+// Then for 1, 2, 4, 8, 16 and 32 threads, each thread opens and closes Count empty scopes, best of 3
+// runs each. Reports the total scopes per second and the time one scope costs its thread. The
+// recorded events are merged and dropped between runs, outside the timing.
+//
+// g++ -O2 -DPROFILING_ENABLED=1 -o profiler_bench bench/profiler_bench.cpp -pthread
+// (add -DPROFILING_ZONES=1 for the cost of an aggregated zone instead, -DPROFILE_STREAM_TRACE=1
+// for a session that streams its trace, -DPROFILE_PERF_COUNTERS=1 to read hardware counters too)
+// ./profiler_bench [count]
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include "../profiler/Profiler.h"
+#include "../timer.cpp"
+
+#if !PROFILING_ENABLED
+#error "Build with -DPROFILING_ENABLED=1, the scopes compile to nothing otherwise"
+#endif
+
+static void RecordScopes(size_t Count) {
+    for (size_t Index = 0; Index < Count; ++Index){
+        PROFILE_SCOPE("bench scope");
+    }
+}
+
+int main(int ArgCount, char **Args) {
+    size_t Count = (ArgCount == 2) ? (size_t)atoll(Args[1]) : 200000;
+    u64 CPUFreq = EstimateCPUTimerFreq();
+    unsigned Cores = std::thread::hardware_concurrency();
+
+    size_t SessionCount = 20*Count;
+    u64 SessionBegin = 0;
+    u64 SessionRecorded = 0;
+    {
+        ProfilerSession Session("profiler_bench", "profiler_bench.json");
+        SessionBegin = ReadCPUTimer();
+        RecordScopes(SessionCount);
+        SessionRecorded = ReadCPUTimer();
+    }
+    u64 SessionEnd = ReadCPUTimer();
+    remove("profiler_bench.json");
+    remove("profiler_bench.json.trace");
+    struct rusage Usage;
+    getrusage(RUSAGE_SELF, &Usage);
+    printf("Session of %zu scopes: %.1f ns/scope, %.1f ms to end it, peak RSS %ld MB\n", SessionCount,
+           1e9 * (double)(SessionRecorded - SessionBegin) / (double)CPUFreq / (double)SessionCount,
+           1e3 * (double)(SessionEnd - SessionRecorded) / (double)CPUFreq, Usage.ru_maxrss / 1024);
+
+    printf("%zu scopes per thread, %u hardware threads:\n", Count, Cores);
+    for (unsigned ThreadCount = 1; ThreadCount <= 32; ThreadCount *= 2){
+        u64 Best = ~0ULL;
+        for (int Repeat = 0; Repeat < 3; ++Repeat){
+            u64 Begin = ReadCPUTimer();
+            std::vector<std::thread> Threads;
+            for (unsigned Thread = 0; Thread < ThreadCount; ++Thread){
+                Threads.emplace_back(RecordScopes, Count);
+            }
+            for (std::thread &Thread : Threads){
+                Thread.join();
+            }
+            u64 Elapsed = ReadCPUTimer() - Begin;
+            if (Elapsed < Best) Best = Elapsed;
+            Profiler::get().clear();
+        }
+
+        // With more threads than cores the threads take turns, so a scope costs its thread the
+        // wall time shared out over the threads that really ran at once
+        double Seconds = (double)Best / (double)CPUFreq;
+        double Scopes = (double)Count * (double)ThreadCount;
+        unsigned Running = (ThreadCount < Cores) ? ThreadCount : Cores;
+        printf("  %2u threads %8.2f M scopes/s %8.1f ns/scope\n", ThreadCount, Scopes / Seconds / 1e6,
+               1e9 * Seconds * (double)Running / Scopes);
+    }
+    return 0;
+}
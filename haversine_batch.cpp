@@ -0,0 +1,251 @@
+// Batch Haversine over structure of arrays inputs, 1, 4 or 8 pairs at a time.
+// ReferenceHaversine() calls libm for every sin, cos, asin and sqrt, one pair at a time. Here the
+// same formula runs on whole vectors (GCC vector extensions), with our own approximations:
+// - sin/cos: reduction to |r| <= pi/4 around the nearest multiple of pi/2 (pi/2 split in three
+//   parts so the reduction is exact for our small multiples), then minimax polynomials in r^2
+// - asin: rational approximation in x^2 up to 0.625, above that around 1 with
+//   asin(x) = pi/2 - 2*asin(sqrt((1-x)/2)) folded in
+// - sqrt: bit trick estimate of 1/sqrt(x), refined by Newton's method
+// The coefficients are the Cephes ones. The same code is compiled for AVX-512 (8 lanes), AVX2 (4
+// lanes) and plain scalar code (1 lane), and the widest one the CPU supports is picked at runtime.
+// Inputs are degrees in the generator's ranges (|x| <= 180, |y| <= 90).
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef double f64x1 __attribute__((vector_size(8)));
+typedef double f64x4 __attribute__((vector_size(32)));
+typedef double f64x8 __attribute__((vector_size(64)));
+typedef int64_t s64x1 __attribute__((vector_size(8)));
+typedef int64_t s64x4 __attribute__((vector_size(32)));
+typedef int64_t s64x8 __attribute__((vector_size(64)));
+
+#define HAVERSINE_INLINE static inline __attribute__((always_inline))
+
+enum haversine_isa {
+    HaversineISA_Scalar,
+    HaversineISA_AVX2,
+    HaversineISA_AVX512,
+
+    HaversineISA_Count,
+};
+
+[[maybe_unused]] static char const *HaversineISAName(haversine_isa ISA){
+    switch (ISA){
+        case HaversineISA_AVX2: return "AVX2";
+        case HaversineISA_AVX512: return "AVX-512";
+        default: return "scalar";
+    }
+}
+
+static bool HaversineISASupported(haversine_isa ISA){
+    __builtin_cpu_init();
+    switch (ISA){
+        case HaversineISA_AVX2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case HaversineISA_AVX512: return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("fma");
+        default: return true;
+    }
+}
+
+[[maybe_unused]] static haversine_isa BestHaversineISA(void){
+    haversine_isa Result = HaversineISA_Scalar;
+    for (int ISA = HaversineISA_Scalar; ISA < HaversineISA_Count; ++ISA){
+        if (HaversineISASupported((haversine_isa)ISA)){
+            Result = (haversine_isa)ISA;
+        }
+    }
+    return Result;
+}
+
+// The helpers below hand vectors back through a pointer rather than returning them: they are
+// instantiated with the default target, where GCC warns (-Wpsabi, reported at the end of the
+// including file so no pragma can scope it) that returning 32 and 64 byte vectors changes the
+// ABI. They are always inlined into functions compiled for the matching ISA, so nothing changes.
+// Constants are broadcast to every lane with V{} + Value.
+
+template <typename V>
+HAVERSINE_INLINE void Load(double const *Source, V *Result){
+    memcpy(Result, Source, sizeof(*Result));
+}
+
+// sqrt(X) for X >= 0
+template <typename V, typename I>
+HAVERSINE_INLINE void SquareRoot(V const &X, V *Result){
+    // 1/sqrt(X) is within 3.5% after the bit trick, each step squares the error
+    V Y = (V)(0x5FE6EB50C7B537A9LL - ((I)X >> 1));
+    V HalfX = X*0.5;
+    for (int Step = 0; Step < 4; ++Step){
+        Y = Y*(1.5 - HalfX*Y*Y);
+    }
+    // One more step on sqrt itself, so the last bit is right
+    V Root = X*Y;
+    *Result = Root + (X - Root*Root)*(Y*0.5);
+}
+
+// sin(X + Quadrant*pi/2), so Quadrant = 1 gives cos(X). Accurate for |X| up to a few pi.
+template <typename V, typename I>
+HAVERSINE_INLINE void Sine(V const &X, int QuadrantOffset, V *Result){
+    V Magic = V{} + 0x1.8p52;
+    V Shifted = X*0.63661977236758134308 + Magic;   // 2/pi, rounded to an integer by the magic
+    V K = Shifted - Magic;
+    I Quadrant = ((I)Shifted + QuadrantOffset) & 3;
+
+    V R = X - K*1.57079632673412561417e+00;
+    R = R - K*6.07710050630396597660e-11;
+    R = R - K*2.02226624879595063154e-21;
+    V Z = R*R;
+
+    V S = V{} + 1.58962301576546568060E-10;
+    S = S*Z - 2.50507477628578072866E-8;
+    S = S*Z + 2.75573136213857245213E-6;
+    S = S*Z - 1.98412698295895385996E-4;
+    S = S*Z + 8.33333333332211858878E-3;
+    S = S*Z - 1.66666666666666307295E-1;
+    S = R + R*Z*S;
+
+    V C = V{} + -1.13585365213876817300E-11;
+    C = C*Z + 2.08757008419747316778E-9;
+    C = C*Z - 2.75573141792967388112E-7;
+    C = C*Z + 2.48015872888517045348E-5;
+    C = C*Z - 1.38888888888730564116E-3;
+    C = C*Z + 4.16666666666665929218E-2;
+    C = 1.0 - Z*0.5 + Z*Z*C;
+
+    // Quadrants 0..3 are sin r, cos r, -sin r, -cos r
+    V Value = ((Quadrant & 1) != 0) ? C : S;
+    *Result = ((Quadrant & 2) != 0) ? -Value : Value;
+}
+
+// asin(X) for 0 <= X <= 1
+template <typename V, typename I>
+HAVERSINE_INLINE void ArcSine(V const &X, V *Result){
+    V Z = X*X;
+    V P = V{} + 4.253011369004428248960E-3;
+    P = P*Z - 6.019598008014123785661E-1;
+    P = P*Z + 5.444622390564711410273E0;
+    P = P*Z - 1.626247967210700244449E1;
+    P = P*Z + 1.956261983317594739197E1;
+    P = P*Z - 8.198089802484824371615E0;
+    V Q = Z - 1.474091372988853791896E1;
+    Q = Q*Z + 7.049610280856842141659E1;
+    Q = Q*Z - 1.471791292232726029859E2;
+    Q = Q*Z + 1.395105614657485689735E2;
+    Q = Q*Z - 4.918853881490881290097E1;
+    V Small = X + X*(Z*P/Q);
+
+    V W = 1.0 - X;
+    V R = V{} + 2.967721961301243206100E-3;
+    R = R*W - 5.634242780008963776856E-1;
+    R = R*W + 6.968710824104713396794E0;
+    R = R*W - 2.556901049652824852289E1;
+    R = R*W + 2.853665548261061424989E1;
+    V S = W - 2.194779531642920639778E1;
+    S = S*W + 1.470656354026814941758E2;
+    S = S*W - 3.838770957603691357202E2;
+    S = S*W + 3.424398657913078477438E2;
+    V Root;
+    SquareRoot<V, I>(W + W, &Root);
+    V PiOver4 = V{} + 7.85398163397448309616E-1;
+    V Large = ((PiOver4 - Root) - (Root*(W*R/S) - 6.123233995736765886130E-17)) + PiOver4;
+
+    *Result = (X > 0.625) ? Large : Small;
+}
+
+template <typename V, typename I>
+HAVERSINE_INLINE void HaversineLanes(V const &X0, V const &Y0, V const &X1, V const &Y1, double EarthRadius, V *Result){
+    double DegreesToRadians = 0.01745329251994329577;
+    V Lat1 = Y0*DegreesToRadians;
+    V Lat2 = Y1*DegreesToRadians;
+    V HalfDLat = (Y1 - Y0)*(0.5*DegreesToRadians);
+    V HalfDLon = (X1 - X0)*(0.5*DegreesToRadians);
+
+    V SinDLat, SinDLon, CosLat1, CosLat2;
+    Sine<V, I>(HalfDLat, 0, &SinDLat);
+    Sine<V, I>(HalfDLon, 0, &SinDLon);
+    Sine<V, I>(Lat1, 1, &CosLat1);
+    Sine<V, I>(Lat2, 1, &CosLat2);
+    V A = SinDLat*SinDLat + CosLat1*CosLat2*(SinDLon*SinDLon);
+    V One = V{} + 1.0;
+    A = (A > One) ? One : A;
+
+    V RootA, ArcSineRootA;
+    SquareRoot<V, I>(A, &RootA);
+    ArcSine<V, I>(RootA, &ArcSineRootA);
+    *Result = (2.0*EarthRadius)*ArcSineRootA;
+}
+
+// Sum of the distances (lane sums added in lane order, so the result only depends on the ISA),
+// and every distance in Distances unless it is null
+template <typename V, typename I>
+HAVERSINE_INLINE double HaversineBatchLanes(double const *X0, double const *Y0, double const *X1, double const *Y1,
+                                            size_t Count, double EarthRadius, double *Distances){
+    enum { Width = sizeof(V) / sizeof(double) };
+    V Sum = {};
+    size_t Index = 0;
+    for (; Index + Width <= Count; Index += Width){
+        V PairX0, PairY0, PairX1, PairY1, Distance;
+        Load(X0 + Index, &PairX0);
+        Load(Y0 + Index, &PairY0);
+        Load(X1 + Index, &PairX1);
+        Load(Y1 + Index, &PairY1);
+        HaversineLanes<V, I>(PairX0, PairY0, PairX1, PairY1, EarthRadius, &Distance);
+        Sum += Distance;
+        if (Distances){
+            memcpy(Distances + Index, &Distance, sizeof(Distance));
+        }
+    }
+
+    if (Index < Count){
+        // Pad with (0, 0) -> (0, 0) pairs, whose distance is 0
+        double Tail[4][Width] = {};
+        size_t TailCount = Count - Index;
+        memcpy(Tail[0], X0 + Index, TailCount*sizeof(double));
+        memcpy(Tail[1], Y0 + Index, TailCount*sizeof(double));
+        memcpy(Tail[2], X1 + Index, TailCount*sizeof(double));
+        memcpy(Tail[3], Y1 + Index, TailCount*sizeof(double));
+        V PairX0, PairY0, PairX1, PairY1, Distance;
+        Load(Tail[0], &PairX0);
+        Load(Tail[1], &PairY0);
+        Load(Tail[2], &PairX1);
+        Load(Tail[3], &PairY1);
+        HaversineLanes<V, I>(PairX0, PairY0, PairX1, PairY1, EarthRadius, &Distance);
+        Sum += Distance;
+        if (Distances){
+            memcpy(Distances + Index, &Distance, TailCount*sizeof(double));
+        }
+    }
+
+    double Result = 0;
+    for (int Lane = 0; Lane < Width; ++Lane){
+        Result += Sum[Lane];
+    }
+    return Result;
+}
+
+__attribute__((target("avx512f,avx2,fma")))
+static double HaversineBatchAVX512(double const *X0, double const *Y0, double const *X1, double const *Y1,
+                                   size_t Count, double EarthRadius, double *Distances){
+    return HaversineBatchLanes<f64x8, s64x8>(X0, Y0, X1, Y1, Count, EarthRadius, Distances);
+}
+
+__attribute__((target("avx2,fma")))
+static double HaversineBatchAVX2(double const *X0, double const *Y0, double const *X1, double const *Y1,
+                                 size_t Count, double EarthRadius, double *Distances){
+    return HaversineBatchLanes<f64x4, s64x4>(X0, Y0, X1, Y1, Count, EarthRadius, Distances);
+}
+
+static double HaversineBatchScalar(double const *X0, double const *Y0, double const *X1, double const *Y1,
+                                   size_t Count, double EarthRadius, double *Distances){
+    return HaversineBatchLanes<f64x1, s64x1>(X0, Y0, X1, Y1, Count, EarthRadius, Distances);
+}
+
+// Returns the sum of the Count distances and, if Distances is not null, stores each of them.
+// The ISA must be supported (see BestHaversineISA).
+static double HaversineBatch(haversine_isa ISA, double const *X0, double const *Y0, double const *X1, double const *Y1,
+                             size_t Count, double EarthRadius, double *Distances = 0){
+    switch (ISA){
+        case HaversineISA_AVX512: return HaversineBatchAVX512(X0, Y0, X1, Y1, Count, EarthRadius, Distances);
+        case HaversineISA_AVX2: return HaversineBatchAVX2(X0, Y0, X1, Y1, Count, EarthRadius, Distances);
+        default: return HaversineBatchScalar(X0, Y0, X1, Y1, Count, EarthRadius, Distances);
+    }
+}
@@ -6,7 +6,14 @@
 #include <math.h>
 #include <string.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "haversine_formula.cpp"
+#include "pair_file.cpp"
 
 typedef uint32_t u32;
 typedef uint64_t u64;
@@ -66,6 +73,90 @@ static double RandomInRange(random_series *Series, double Min, double Max){
     return Result;
 }
 
+// Writes Value exactly as printf("%.16f") does (the exact binary value rounded half to even at
+// the 16th decimal), without parsing a format string or going through long double arithmetic.
+// Value * 10^16 = Mantissa * 5^16 * 2^(Exponent - 1075 + 16), which is exact in 128 bits.
+static int FormatDegree(char *Out, double Value){
+    u64 Bits;
+    memcpy(&Bits, &Value, sizeof(Bits));
+    int Exponent = (int)((Bits >> 52) & 0x7FF);
+    u64 Mantissa = Bits & ((1ULL << 52) - 1);
+
+    // Degrees never get near this, but anything whose scaled value would not fit in a u64
+    // (and NaN/inf) goes through the C library
+    if ((Exponent == 0x7FF) || (fabs(Value) >= 900.0)){
+        return sprintf(Out, "%.16f", Value);
+    }
+
+    if (Exponent == 0){
+        Exponent = 1;
+    } else {
+        Mantissa |= (1ULL << 52);
+    }
+
+    // Below 900 the power of two is always negative: shift right, rounding half to even
+    int Shift = 1075 - 16 - Exponent;
+    unsigned __int128 Scaled = (unsigned __int128)Mantissa * 152587890625ULL; // 5^16
+    u64 Fixed = 0;
+    if (Shift < 128){
+        unsigned __int128 One = 1;
+        unsigned __int128 Remainder = Scaled & ((One << Shift) - 1);
+        unsigned __int128 Half = One << (Shift - 1);
+        Fixed = (u64)(Scaled >> Shift);
+        if ((Remainder > Half) || ((Remainder == Half) && (Fixed & 1))){
+            ++Fixed;
+        }
+    }
+
+    char *At = Out;
+    if (Bits >> 63){
+        *At++ = '-';
+    }
+
+    u64 Whole = Fixed / 10000000000000000ULL;
+    u64 Fraction = Fixed % 10000000000000000ULL;
+    char Digits[20];
+    int DigitCount = 0;
+    do {
+        Digits[DigitCount++] = (char)('0' + (Whole % 10));
+        Whole /= 10;
+    } while (Whole);
+    while (DigitCount){
+        *At++ = Digits[--DigitCount];
+    }
+
+    *At++ = '.';
+    for (int Digit = 15; Digit >= 0; --Digit){
+        At[Digit] = (char)('0' + (Fraction % 10));
+        Fraction /= 10;
+    }
+    At += 16;
+
+    return (int)(At - Out);
+}
+
+// Upper bound on the text of one pair line, FormatDegree writes at most 21 characters below 900
+#define MaxPairText 128
+
+static int FormatPair(char *Out, double X0, double Y0, double X1, double Y1, bool Last){
+    char *At = Out;
+    memcpy(At, "    {\"x0\":", 10); At += 10;
+    At += FormatDegree(At, X0);
+    memcpy(At, ", \"y0\":", 7); At += 7;
+    At += FormatDegree(At, Y0);
+    memcpy(At, ", \"x1\":", 7); At += 7;
+    At += FormatDegree(At, X1);
+    memcpy(At, ", \"y1\":", 7); At += 7;
+    At += FormatDegree(At, Y1);
+    if (Last){
+        memcpy(At, "}\n", 2); At += 2;
+    } else {
+        memcpy(At, "},\n", 3); At += 3;
+    }
+
+    return (int)(At - Out);
+}
+
 static FILE* Open(long long unsigned PairCount, const char *Label, const char *Extension){
     char Temp[256];
     sprintf(Temp, "data_%llu_%s.%s", PairCount, Label, Extension);
@@ -93,8 +184,178 @@ static double RandomDegree(random_series *Series, double Center, double Radius,
     return Result;
 }
 
+// Chunked generation: the pairs are cut into chunks of a fixed ChunkPairCount, each with its own
+// random series derived from the seed, and every cluster gets its own series too. What a chunk
+// contains depends only on the seed and its index, so the files are byte identical whatever the
+// thread count (but not identical to the single series output, which draws everything in turn).
+#define ChunkPairCount (1 << 16)
+
+struct generation_params {
+    u64 PairCount;
+    u64 Base;          // drawn from Seed(), every chunk and cluster series is derived from it
+    u64 ClusterSpan;   // pairs per cluster, 0 for uniform
+    double SumCoef;
+    double EarthRadius;
+    double *Columns[4]; // binary pair file columns, 0 when not written
+};
+
+struct pair_chunk {
+    std::vector<char> Text;
+    std::vector<double> Distances;
+    size_t TextSize;
+    double Sum;
+    u64 Index;         // chunk the slot holds
+    bool Ready;
+};
+
+static random_series DerivedSeries(u64 Base, u64 Stream, u64 Index){
+    random_series Result = Seed(Base ^ ((2*Index + Stream + 1) * 0x9E3779B97F4A7C15ULL));
+    return Result;
+}
+
+static void GenerateChunk(generation_params const &Params, u64 ChunkIndex, pair_chunk *Chunk){
+    double MaxAllowedX = 180.0;
+    double MaxAllowedY = 90.0;
+
+    double XCenter = 0.0;
+    double YCenter = 0.0;
+    double XRadius = MaxAllowedX;
+    double YRadius = MaxAllowedY;
+    u64 Cluster = U64Max;
+
+    random_series Series = DerivedSeries(Params.Base, 0, ChunkIndex);
+    u64 First = ChunkIndex * ChunkPairCount;
+    u64 Count = Params.PairCount - First;
+    if (Count > ChunkPairCount){
+        Count = ChunkPairCount;
+    }
+
+    // A slot only grows to what the chunks it holds need, so a short last chunk stays small
+    if (Chunk->Text.size() < Count*MaxPairText){
+        Chunk->Text.resize((size_t)Count*MaxPairText);
+        Chunk->Distances.resize((size_t)Count);
+    }
+
+    char *Text = Chunk->Text.data();
+    double Sum = 0;
+    for (u64 Offset = 0; Offset < Count; ++Offset){
+        u64 PairIndex = First + Offset;
+        if (Params.ClusterSpan && (PairIndex / Params.ClusterSpan != Cluster)){
+            Cluster = PairIndex / Params.ClusterSpan;
+            random_series ClusterSeries = DerivedSeries(Params.Base, 1, Cluster);
+            XCenter = RandomInRange(&ClusterSeries, -MaxAllowedX, MaxAllowedX);
+            YCenter = RandomInRange(&ClusterSeries, -MaxAllowedY, MaxAllowedY);
+            XRadius = RandomInRange(&ClusterSeries, 0.0, MaxAllowedX);
+            YRadius = RandomInRange(&ClusterSeries, 0.0, MaxAllowedY);
+        }
+
+        double X0 = RandomDegree(&Series, XCenter, XRadius, MaxAllowedX);
+        double Y0 = RandomDegree(&Series, YCenter, YRadius, MaxAllowedY);
+        double X1 = RandomDegree(&Series, XCenter, XRadius, MaxAllowedX);
+        double Y1 = RandomDegree(&Series, YCenter, YRadius, MaxAllowedY);
+
+        double HaversineDistance = ReferenceHaversine(X0, Y0, X1, Y1, Params.EarthRadius);
+        Sum += Params.SumCoef * HaversineDistance;
+        Chunk->Distances[Offset] = HaversineDistance;
+        if (Params.Columns[0]){
+            Params.Columns[0][PairIndex] = X0;
+            Params.Columns[1][PairIndex] = Y0;
+            Params.Columns[2][PairIndex] = X1;
+            Params.Columns[3][PairIndex] = Y1;
+        }
+        Text += FormatPair(Text, X0, Y0, X1, Y1, PairIndex == (Params.PairCount - 1));
+    }
+
+    Chunk->TextSize = (size_t)(Text - Chunk->Text.data());
+    Chunk->Sum = Sum;
+}
+
+// Workers generate chunks in any order into a ring of slots, this thread writes them in chunk
+// order and adds up the chunk sums in that same order, so the sum is reproducible as well.
+static double GenerateChunked(generation_params const &Params, u32 ThreadCount, FILE *FlexJSON, FILE *HaverAnswers){
+    u64 ChunkCount = (Params.PairCount + ChunkPairCount - 1) / ChunkPairCount;
+    u64 SlotCount = 2*(u64)ThreadCount;
+    if (SlotCount > ChunkCount){
+        SlotCount = ChunkCount;
+    }
+    std::vector<pair_chunk> Slots(SlotCount);
+    for (pair_chunk &Slot : Slots){
+        Slot.Ready = false;
+    }
+
+    std::mutex Mutex;
+    std::condition_variable ChunkReady;
+    std::condition_variable SlotFree;
+    std::atomic<u64> NextChunk(0);
+    u64 Written = 0;   // guarded by Mutex
+
+    auto Worker = [&]() {
+        for (u64 ChunkIndex = NextChunk++; ChunkIndex < ChunkCount; ChunkIndex = NextChunk++){
+            pair_chunk *Slot = &Slots[ChunkIndex % Slots.size()];
+            {
+                std::unique_lock<std::mutex> Lock(Mutex);
+                SlotFree.wait(Lock, [&] { return ChunkIndex < Written + Slots.size(); });
+            }
+            GenerateChunk(Params, ChunkIndex, Slot);
+            {
+                std::lock_guard<std::mutex> Lock(Mutex);
+                Slot->Index = ChunkIndex;
+                Slot->Ready = true;
+            }
+            ChunkReady.notify_one();
+        }
+    };
+
+    std::vector<std::thread> Workers;
+    for (u32 Thread = 0; Thread < ThreadCount; ++Thread){
+        Workers.emplace_back(Worker);
+    }
+
+    double Sum = 0;
+    for (u64 ChunkIndex = 0; ChunkIndex < ChunkCount; ++ChunkIndex){
+        pair_chunk *Slot = &Slots[ChunkIndex % Slots.size()];
+        {
+            std::unique_lock<std::mutex> Lock(Mutex);
+            ChunkReady.wait(Lock, [&] { return Slot->Ready && (Slot->Index == ChunkIndex); });
+        }
+
+        u64 Count = Params.PairCount - ChunkIndex * ChunkPairCount;
+        if (Count > ChunkPairCount){
+            Count = ChunkPairCount;
+        }
+        fwrite(Slot->Text.data(), 1, Slot->TextSize, FlexJSON);
+        fwrite(Slot->Distances.data(), sizeof(double), Count, HaverAnswers);
+        Sum += Slot->Sum;
+
+        {
+            std::lock_guard<std::mutex> Lock(Mutex);
+            Slot->Ready = false;
+            ++Written;
+        }
+        SlotFree.notify_all();
+    }
+
+    for (std::thread &Thread : Workers){
+        Thread.join();
+    }
+
+    return Sum;
+}
+
 int main(int ArgCount, char **Args) {
-    if (ArgCount == 4){
+    // --binary (anywhere) also writes the pairs as a binary pair file, see pair_file.cpp
+    bool WriteBinary = false;
+    int PositionalCount = 0;
+    for (int ArgIndex = 0; ArgIndex < ArgCount; ++ArgIndex){
+        if (strcmp(Args[ArgIndex], "--binary") == 0){
+            WriteBinary = true;
+        } else {
+            Args[PositionalCount++] = Args[ArgIndex];
+        }
+    }
+    ArgCount = PositionalCount;
+
+    if ((ArgCount == 4) || (ArgCount == 5)){
         u64 ClusterCountLeft = U64Max;
         double MaxAllowedX = 180.0;
         double MaxAllowedY = 90.0;
@@ -115,18 +376,56 @@ int main(int ArgCount, char **Args) {
         u64 SeedValue = atoll(Args[2]);
         random_series series = Seed(SeedValue);
 
+        // Giving a thread count (even 1) selects the chunked generation
+        u32 ThreadCount = 0;
+        if (ArgCount == 5){
+            ThreadCount = (u32)atoi(Args[4]);
+            if (ThreadCount < 1){
+                ThreadCount = 1;
+            }
+        }
+
         u64 MaxPairCount = (1ULL << 34);
         u64 PairCount = atoll(Args[3]);
         if (PairCount < MaxPairCount){
             u64 ClusterCountMax = 1 + (PairCount / 64);
 
+            // More threads than chunks would only sit idle
+            u64 ChunkCount = (PairCount + ChunkPairCount - 1) / ChunkPairCount;
+            if (ThreadCount > ChunkCount){
+                ThreadCount = (ChunkCount > 0) ? (u32)ChunkCount : 1;
+            }
+
             FILE *FlexJSON = Open(PairCount, "flex", "json");
             FILE *HaverAnswers = Open(PairCount, "haveranswer", "json");
             if (FlexJSON && HaverAnswers){
+                // Only created once the text files are open, so a failed open leaves no headerless pair file behind
+                pair_file_output Binary = {};
+                if (WriteBinary){
+                    char Temp[256];
+                    sprintf(Temp, "data_%llu_pairs.bin", (long long unsigned)PairCount);
+                    if (!CreatePairFile(Temp, PairCount, 0, &Binary)){
+                        fprintf(stderr, "Unable to create \"%s\".\n", Temp);
+                        WriteBinary = false;
+                    }
+                }
+
                 fprintf(FlexJSON, "{\"pairs\":[\n");
                 double Sum = 0;
                 double sumCoef = 1.0/(double)PairCount;
-                for(u64 PairIndex = 0; PairIndex < PairCount; ++PairIndex){
+                if (ThreadCount){
+                    generation_params Params = {};
+                    Params.PairCount = PairCount;
+                    Params.Base = RandomU64(&series);
+                    Params.ClusterSpan = (ClusterCountLeft == 0) ? (ClusterCountMax + 1) : 0;
+                    Params.SumCoef = sumCoef;
+                    Params.EarthRadius = 6371.8;
+                    for (u32 Column = 0; Column < 4; ++Column){
+                        Params.Columns[Column] = Binary.Columns[Column];
+                    }
+                    Sum = GenerateChunked(Params, ThreadCount, FlexJSON, HaverAnswers);
+                }
+                for(u64 PairIndex = 0; !ThreadCount && (PairIndex < PairCount); ++PairIndex){
                     if (ClusterCountLeft-- == 0){
                         ClusterCountLeft = ClusterCountMax;
                         XCenter = RandomInRange(&series, -MaxAllowedX, MaxAllowedX);
@@ -144,17 +443,35 @@ int main(int ArgCount, char **Args) {
                     double HaversineDistance = ReferenceHaversine(X0, Y0, X1, Y1, EarthRadius);
 
                     Sum += sumCoef * HaversineDistance;
-                    char const *JSONSep = (PairIndex == (PairCount - 1)) ? "\n" : ",\n";
-                    fprintf(FlexJSON, "    {\"x0\":%.16f, \"y0\":%.16f, \"x1\":%.16f, \"y1\":%.16f}%s", X0, Y0, X1, Y1, JSONSep);
+                    char PairText[MaxPairText];
+                    int PairSize = FormatPair(PairText, X0, Y0, X1, Y1, PairIndex == (PairCount - 1));
+                    fwrite(PairText, 1, PairSize, FlexJSON);
+                    if (WriteBinary){
+                        Binary.Columns[0][PairIndex] = X0;
+                        Binary.Columns[1][PairIndex] = Y0;
+                        Binary.Columns[2][PairIndex] = X1;
+                        Binary.Columns[3][PairIndex] = Y1;
+                    }
                     
                     fwrite(&HaversineDistance, sizeof(HaversineDistance), 1, HaverAnswers);
                 }
                 fprintf(FlexJSON, "]}\n");
                 fwrite(&Sum, sizeof(Sum), 1, HaverAnswers);
+                if (WriteBinary){
+                    pair_file_header Header = {};
+                    Header.Method = (strcmp(MethodName, "cluster") == 0) ? PairMethod_Cluster : PairMethod_Uniform;
+                    Header.PairCount = PairCount;
+                    Header.Seed = SeedValue;
+                    Header.ExpectedSum = Sum;
+                    FinishPairFile(&Binary, &Header);
+                }
         
                 fprintf(stdout, "Method: %s\n", MethodName);
                 fprintf(stdout, "Random seed: %llu\n", (long long unsigned)SeedValue);
                 fprintf(stdout, "Pair count: %llu\n", (long long unsigned)PairCount);
+                if (ThreadCount){
+                    fprintf(stdout, "Threads: %u (chunks of %d pairs)\n", ThreadCount, ChunkPairCount);
+                }
                 fprintf(stdout, "Expected sum: %.16f\n", Sum);
             }
             
@@ -165,7 +482,7 @@ int main(int ArgCount, char **Args) {
             fprintf(stderr, "To avoid accidentally generating massive files, number of pairs must be less than %llu.\n", MaxPairCount);
         }
     } else {
-        fprintf(stderr, "Usage: %s [uniform/cluster] [random seed] [number of coordinate paris to generate]\n", Args[0]);
+        fprintf(stderr, "Usage: %s [uniform/cluster] [random seed] [number of coordinate paris to generate] [threads] [--binary]\n", Args[0]);
     }
 
     return 0;
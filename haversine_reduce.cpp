@@ -0,0 +1,116 @@
+// Parallel sum of Haversine distances over structure of arrays inputs, bit identical for any
+// thread count. The pairs are cut into blocks of a fixed ReduceBlockPairs, each block is summed
+// with Neumaier's compensated summation, and the block sums are combined in a fixed pairwise tree.
+// Which thread sums which block changes nothing, so neither does the number of threads.
+// Needs haversine_formula.cpp and haversine_batch.cpp included first.
+#include <atomic>
+#include <math.h>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+typedef uint32_t u32;
+
+// Small enough that a block of distances stays in L2 for the batch kernel
+#define ReduceBlockPairs (1 << 14)
+
+struct neumaier_sum {
+    double Sum;
+    double Compensation;   // the low order bits lost by Sum so far
+};
+
+static void NeumaierAdd(neumaier_sum *Accumulator, double Value){
+    double Total = Accumulator->Sum + Value;
+    if (fabs(Accumulator->Sum) >= fabs(Value)){
+        Accumulator->Compensation += (Accumulator->Sum - Total) + Value;
+    } else {
+        Accumulator->Compensation += (Value - Total) + Accumulator->Sum;
+    }
+    Accumulator->Sum = Total;
+}
+
+static neumaier_sum NeumaierCombine(neumaier_sum A, neumaier_sum B){
+    NeumaierAdd(&A, B.Sum);
+    A.Compensation += B.Compensation;
+    return A;
+}
+
+struct reduce_job {
+    double const *X0, *Y0, *X1, *Y1;
+    size_t PairCount;
+    double EarthRadius;
+    bool Batch;
+    haversine_isa ISA;
+
+    std::atomic<size_t> NextBlock;
+    std::vector<neumaier_sum> Blocks;
+};
+
+// Workers (and the calling thread) take blocks in turn until none is left
+static void ReduceBlocks(reduce_job *Job){
+    std::vector<double> Distances(Job->Batch ? ReduceBlockPairs : 0);
+    for (size_t Block = Job->NextBlock++; Block < Job->Blocks.size(); Block = Job->NextBlock++){
+        size_t First = Block*ReduceBlockPairs;
+        size_t Count = Job->PairCount - First;
+        if (Count > ReduceBlockPairs){
+            Count = ReduceBlockPairs;
+        }
+
+        neumaier_sum Sum = {};
+        if (Job->Batch){
+            HaversineBatch(Job->ISA, Job->X0 + First, Job->Y0 + First, Job->X1 + First, Job->Y1 + First, Count,
+                           Job->EarthRadius, Distances.data());
+            for (size_t Index = 0; Index < Count; ++Index){
+                NeumaierAdd(&Sum, Distances[Index]);
+            }
+        } else {
+            for (size_t Index = First; Index < First + Count; ++Index){
+                NeumaierAdd(&Sum, ReferenceHaversine(Job->X0[Index], Job->Y0[Index], Job->X1[Index], Job->Y1[Index], Job->EarthRadius));
+            }
+        }
+        Job->Blocks[Block] = Sum;
+    }
+}
+
+static neumaier_sum CombineBlocks(neumaier_sum const *Blocks, size_t Count){
+    if (Count == 1){
+        return Blocks[0];
+    }
+    size_t Half = Count / 2;
+    neumaier_sum Result = NeumaierCombine(CombineBlocks(Blocks, Half), CombineBlocks(Blocks + Half, Count - Half));
+    return Result;
+}
+
+// Sum of the PairCount distances, computed by ThreadCount threads (the caller being one of them).
+// With Batch the distances come from the widest batch kernel the CPU supports instead of ReferenceHaversine.
+static double SumHaversineParallel(double const *X0, double const *Y0, double const *X1, double const *Y1,
+                                   size_t PairCount, double EarthRadius, bool Batch, u32 ThreadCount){
+    if (PairCount == 0){
+        return 0;
+    }
+
+    reduce_job Job;
+    Job.X0 = X0;
+    Job.Y0 = Y0;
+    Job.X1 = X1;
+    Job.Y1 = Y1;
+    Job.PairCount = PairCount;
+    Job.EarthRadius = EarthRadius;
+    Job.Batch = Batch;
+    Job.ISA = BestHaversineISA();
+    Job.NextBlock = 0;
+    Job.Blocks.resize((PairCount + ReduceBlockPairs - 1) / ReduceBlockPairs);
+
+    std::vector<std::thread> Workers;
+    for (u32 Thread = 1; Thread < ThreadCount && Thread < Job.Blocks.size(); ++Thread){
+        Workers.emplace_back(ReduceBlocks, &Job);
+    }
+    ReduceBlocks(&Job);
+    for (std::thread &Worker : Workers){
+        Worker.join();
+    }
+
+    neumaier_sum Total = CombineBlocks(Job.Blocks.data(), Job.Blocks.size());
+    double Result = Total.Sum + Total.Compensation;
+    return Result;
+}
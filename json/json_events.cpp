@@ -0,0 +1,116 @@
+#include "json_events.hpp"
+#include "json_number.hpp"
+#include <stdexcept>
+
+//                                                  ---- Event Reader Implementation ----
+EventReader::EventReader(Lexer& lexer)
+    : lexer(lexer), currentToken(lexer.getNextToken()), state(State::VALUE), number_(0), boolean_(false) {}
+
+void EventReader::expect(TokenType type) {
+    if (currentToken.type == type){
+        currentToken = lexer.getNextToken();
+    } else {
+        throw std::runtime_error("Unexpected token: expected one type, got another");
+    }
+}
+
+JsonEvent EventReader::next() {
+    switch (state){
+        case State::VALUE:
+            return readValue();
+        case State::OBJECT_FIRST:
+            if (currentToken.type == TokenType::RBRACE){
+                expect(TokenType::RBRACE);
+                return closeContainer(JsonEvent::END_OBJECT);
+            }
+            return readKey();
+        case State::AFTER_KEY:
+            expect(TokenType::COLON);
+            return readValue();
+        case State::ARRAY_FIRST:
+            if (currentToken.type == TokenType::RBRACKET){
+                expect(TokenType::RBRACKET);
+                return closeContainer(JsonEvent::END_ARRAY);
+            }
+            return readValue();
+        case State::AFTER_VALUE:
+            if (stack.empty()){
+                if (currentToken.type != TokenType::EOF_T){
+                    throw std::runtime_error("unexpected characters at the end of file");
+                }
+                state = State::DONE;
+                return JsonEvent::END_DOCUMENT;
+            }
+            if (stack.back() == '{'){
+                if (currentToken.type == TokenType::RBRACE){
+                    expect(TokenType::RBRACE);
+                    return closeContainer(JsonEvent::END_OBJECT);
+                }
+                expect(TokenType::COMMA);
+                return readKey();
+            }
+            if (currentToken.type == TokenType::RBRACKET){
+                expect(TokenType::RBRACKET);
+                return closeContainer(JsonEvent::END_ARRAY);
+            }
+            expect(TokenType::COMMA);
+            return readValue();
+        case State::DONE:
+        default:
+            return JsonEvent::END_DOCUMENT;
+    }
+}
+
+JsonEvent EventReader::closeContainer(JsonEvent event) {
+    stack.pop_back();
+    state = State::AFTER_VALUE;
+    return event;
+}
+
+JsonEvent EventReader::readKey() {
+    if (currentToken.type != TokenType::STRING){
+        throw std::runtime_error("expected string key");
+    }
+    // The ':' is only consumed on the next call
+    text_ = currentToken.value;
+    expect(TokenType::STRING);
+    state = State::AFTER_KEY;
+    return JsonEvent::KEY;
+}
+
+JsonEvent EventReader::readValue() {
+    switch (currentToken.type){
+        case TokenType::LBRACE:
+            expect(TokenType::LBRACE);
+            stack.push_back('{');
+            state = State::OBJECT_FIRST;
+            return JsonEvent::START_OBJECT;
+        case TokenType::LBRACKET:
+            expect(TokenType::LBRACKET);
+            stack.push_back('[');
+            state = State::ARRAY_FIRST;
+            return JsonEvent::START_ARRAY;
+        case TokenType::STRING:
+            text_ = currentToken.value;
+            expect(TokenType::STRING);
+            state = State::AFTER_VALUE;
+            return JsonEvent::STRING;
+        case TokenType::NUMBER:
+            // NOTE: same conversion as Parser::parseNumber
+            number_ = parseJsonNumber(currentToken.value);
+            expect(TokenType::NUMBER);
+            state = State::AFTER_VALUE;
+            return JsonEvent::NUMBER;
+        case TokenType::BOOLEAN:
+            boolean_ = (currentToken.value == "true");
+            expect(TokenType::BOOLEAN);
+            state = State::AFTER_VALUE;
+            return JsonEvent::BOOLEAN;
+        case TokenType::NULL_T:
+            expect(TokenType::NULL_T);
+            state = State::AFTER_VALUE;
+            return JsonEvent::NULL_T;
+        default:
+            throw std::runtime_error("unexpected token when parsing value");
+    }
+}
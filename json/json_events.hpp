@@ -0,0 +1,83 @@
+//     __ _____ _____ _____
+//  __|  |   __|     |   | |  Simple JSON
+// |  |  |__   |  |  | | | |  version 1.0.0
+// |_____|_____|_____|_|___|
+// Copyright (c) 2025, Muhammad Ahmed
+#ifndef JSON_EVENTS_HPP
+#define JSON_EVENTS_HPP
+
+#include <string_view>
+#include <vector>
+#include "json_parser.hpp"
+
+enum class JsonEvent {
+    START_OBJECT, // {
+    END_OBJECT,   // }
+    START_ARRAY,  // [
+    END_ARRAY,    // ]
+    KEY,          // "key":
+    STRING,       // "..."
+    NUMBER,       // 123.456
+    BOOLEAN,      // true or false
+    NULL_T,       // null
+    END_DOCUMENT  // returned once the whole value has been read (and forever after)
+};
+
+//                                                  ---- Event Reader Class ----
+/**
+ * @brief Pull parser that turns the token stream into a stream of events without building a DOM
+ *
+ * It accepts exactly the same grammar as Parser, but only keeps a stack with one entry per
+ * open object/array, so memory does not grow with the size of the input.
+ *
+ * Usage:
+ *     EventReader reader(lexer);
+ *     for (JsonEvent event = reader.next(); event != JsonEvent::END_DOCUMENT; event = reader.next()) {...}
+ */
+class EventReader {
+    private:
+        enum class State {
+            VALUE,        // a value must come next (top level, after ':' or after ',' in an array)
+            OBJECT_FIRST, // just after '{': a key or '}'
+            AFTER_KEY,    // after a key: ':' then a value
+            ARRAY_FIRST,  // just after '[': a value or ']'
+            AFTER_VALUE,  // after a complete value: ',' or the closing bracket of the container
+            DONE
+        };
+
+        JsonEvent readValue();
+        JsonEvent readKey();
+        JsonEvent closeContainer(JsonEvent event);
+        void expect(TokenType type);
+
+        Lexer& lexer;
+        Token currentToken;
+        State state;
+        std::vector<char> stack; // '{' or '[' for every open container
+
+        std::string_view text_;
+        double number_;
+        bool boolean_;
+    public:
+        /**
+         * @brief Constructor for the EventReader
+         * @param lexer The lexer to use for tokenization
+         */
+        EventReader(Lexer& lexer);
+
+        /**
+         * @brief Read the next event, throws std::runtime_error on malformed input
+         */
+        JsonEvent next();
+
+        // Payload of the event that was just returned
+        // text() is only valid until the next call to next()
+        std::string_view text() const { return text_; }   // KEY, STRING
+        double number() const { return number_; }         // NUMBER
+        bool boolean() const { return boolean_; }         // BOOLEAN
+
+        // Number of containers currently open (1 right after the START_OBJECT of the root)
+        size_t depth() const { return stack.size(); }
+};
+
+#endif // JSON_EVENTS_HPP
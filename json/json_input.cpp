@@ -0,0 +1,252 @@
+#include "json_input.hpp"
+#include "../profiler/Profiler.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//                                                  ---- Input File Implementation ----
+InputFile::InputFile(const std::string& path, InputMethod method, bool prefault)
+    : base(""), length(0), buffer(nullptr), mapped(false) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0){
+        throw std::runtime_error("Could not open file: " + path);
+    }
+    try {
+        if (method == InputMethod::MMAP){
+            mapFile(fd, prefault);
+        }
+        if (!mapped){
+            readFile(fd);
+        }
+    } catch (...) {
+        close(fd);
+        std::free(buffer);
+        throw;
+    }
+    // A mapping stays valid after its descriptor is closed
+    close(fd);
+}
+
+InputFile::~InputFile() {
+    if (mapped){
+        munmap(const_cast<char*>(base), length);
+    }
+    std::free(buffer);
+}
+
+void InputFile::mapFile(int fd, bool prefault) {
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size <= 0){
+        return;
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    int flags = MAP_PRIVATE | (prefault ? MAP_POPULATE : 0);
+    void* memory = mmap(nullptr, size, PROT_READ, flags, fd, 0);
+    if (memory == MAP_FAILED){
+        return;
+    }
+    // Only hints: failing any of them changes nothing but speed
+    madvise(memory, size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    madvise(memory, size, MADV_HUGEPAGE);
+#endif
+    if (prefault){
+        madvise(memory, size, MADV_WILLNEED);
+    }
+    base = static_cast<const char*>(memory);
+    length = size;
+    mapped = true;
+}
+
+void InputFile::readFile(int fd) {
+    // Regular files are read into a buffer of exactly their size, anything else grows as it comes
+    struct stat info;
+    size_t capacity = 64 * 1024;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0){
+        capacity = static_cast<size_t>(info.st_size);
+    }
+    PROFILE_BANDWIDTH("Read", capacity);
+    buffer = static_cast<char*>(std::malloc(capacity));
+    if (!buffer){
+        throw std::bad_alloc();
+    }
+    size_t size = 0;
+    while (true){
+        if (size == capacity){
+            // Probe for EOF before growing, so a file of the expected size needs no realloc
+            char probe;
+            ssize_t count = read(fd, &probe, 1);
+            if (count == 0){
+                break;
+            }
+            if (count < 0){
+                if (errno == EINTR){
+                    continue;
+                }
+                throw std::runtime_error(std::string("Could not read file: ") + std::strerror(errno));
+            }
+            char* grown = static_cast<char*>(std::realloc(buffer, 2*capacity));
+            if (!grown){
+                throw std::bad_alloc();
+            }
+            buffer = grown;
+            capacity *= 2;
+            buffer[size++] = probe;
+            continue;
+        }
+        ssize_t count = read(fd, buffer + size, capacity - size);
+        if (count == 0){
+            break;
+        }
+        if (count < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            throw std::runtime_error(std::string("Could not read file: ") + std::strerror(errno));
+        }
+        size += static_cast<size_t>(count);
+    }
+    base = buffer;
+    length = size;
+}
+
+//                                                  ---- File Stream Implementation ----
+FileStream::FileStream(const std::string& path) : fd(open(path.c_str(), O_RDONLY)) {
+    if (fd < 0){
+        throw std::runtime_error("Could not open file: " + path);
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+FileStream::~FileStream() {
+    close(fd);
+}
+
+size_t FileStream::read(char* buffer, size_t size) {
+    while (true){
+        ssize_t count = ::read(fd, buffer, size);
+        if (count >= 0){
+            return static_cast<size_t>(count);
+        }
+        if (errno != EINTR){
+            throw std::runtime_error(std::string("Could not read file: ") + std::strerror(errno));
+        }
+    }
+}
+
+//                                                  ---- Read Ahead Stream Implementation ----
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+ReadAheadStream::ReadAheadStream(InputStream& source, size_t blockSize, size_t blockCount)
+    : source(source), blocks(std::max<size_t>(blockCount, 2), std::vector<char>(std::max<size_t>(blockSize, 1))),
+      filled(blocks.size(), 0), readyCount(0), finished(false), stopping(false), counters{0, 0.0, 0.0, 0.0},
+      head(0), offset(0) {
+    reader = std::thread(&ReadAheadStream::run, this);
+}
+
+ReadAheadStream::~ReadAheadStream() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    blockFreed.notify_one();
+    reader.join();
+}
+
+void ReadAheadStream::run() {
+    size_t tail = 0;
+    while (true){
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            auto start = std::chrono::steady_clock::now();
+            blockFreed.wait(lock, [this] { return stopping || readyCount < blocks.size(); });
+            counters.readerStalled += secondsSince(start);
+            if (stopping){
+                return;
+            }
+        }
+
+        // The block is ours until it is published, fill it outside the lock
+        std::vector<char>& block = blocks[tail];
+        size_t size = 0;
+        bool ended = false;
+        std::exception_ptr failure;
+        auto start = std::chrono::steady_clock::now();
+        try {
+            while (size < block.size()){
+                size_t count = source.read(block.data() + size, block.size() - size);
+                if (count == 0){
+                    ended = true;
+                    break;
+                }
+                size += count;
+            }
+        } catch (...) {
+            failure = std::current_exception();
+            ended = true;
+        }
+        double seconds = secondsSince(start);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.readSeconds += seconds;
+            counters.bytes += size;
+            filled[tail] = size;
+            if (size > 0){
+                ++readyCount;
+            }
+            finished = ended;
+            error = failure;
+        }
+        blockFilled.notify_one();
+        if (ended){
+            return;
+        }
+        tail = (tail + 1) % blocks.size();
+    }
+}
+
+size_t ReadAheadStream::read(char* buffer, size_t size) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto start = std::chrono::steady_clock::now();
+        blockFilled.wait(lock, [this] { return readyCount > 0 || finished; });
+        counters.consumerStalled += secondsSince(start);
+        if (readyCount == 0){
+            if (error){
+                std::rethrow_exception(error);
+            }
+            return 0;
+        }
+    }
+
+    // The head block is ours until it is released
+    size_t count = std::min(size, filled[head] - offset);
+    std::copy(blocks[head].begin() + offset, blocks[head].begin() + offset + count, buffer);
+    offset += count;
+    if (offset == filled[head]){
+        offset = 0;
+        head = (head + 1) % blocks.size();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --readyCount;
+        }
+        blockFreed.notify_one();
+    }
+    return count;
+}
+
+ReadAheadStream::Stats ReadAheadStream::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
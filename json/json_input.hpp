@@ -0,0 +1,151 @@
+//     __ _____ _____ _____
+//  __|  |   __|     |   | |  Simple JSON
+// |  |  |__   |  |  | | | |  version 1.0.0
+// |_____|_____|_____|_|___|
+// Copyright (c) 2025, Muhammad Ahmed
+#ifndef JSON_INPUT_HPP
+#define JSON_INPUT_HPP
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+enum class InputMethod {
+    MMAP, // map the file read only, pages are faulted in as the lexer touches them (unless prefaulted)
+    READ  // read() the whole file into one buffer allocated at its exact size
+};
+
+//                                                  ---- Input File Class ----
+/**
+ * @brief The whole content of a file as one contiguous, read only std::string_view
+ *
+ * With MMAP no byte is copied: the lexer reads straight from the page cache. The mapping is
+ * advised as sequential (and as a huge page candidate where the kernel supports that for files),
+ * and can be pre-faulted so that the cost of bringing it in is paid up front instead of inside the
+ * parser. If the file cannot be mapped (empty file, pipe, ...) READ is used instead.
+ *
+ * Usage:
+ *     InputFile file("data.json");
+ *     Lexer lexer(file.data());
+ */
+class InputFile {
+    private:
+        void mapFile(int fd, bool prefault);
+        void readFile(int fd);
+
+        const char* base;
+        size_t length;
+        char* buffer;  // owned when READ was used
+        bool mapped;
+    public:
+        /**
+         * @brief Open and load the file, throws std::runtime_error if it cannot be read
+         * @param path The file to load
+         * @param method How to load it (MMAP falls back to READ when mapping is not possible)
+         * @param prefault With MMAP, fault every page in now instead of on first access
+         */
+        InputFile(const std::string& path, InputMethod method = InputMethod::MMAP, bool prefault = false);
+        ~InputFile();
+
+        InputFile(const InputFile&) = delete;
+        InputFile& operator=(const InputFile&) = delete;
+
+        std::string_view data() const { return std::string_view(base, length); }
+        size_t size() const { return length; }
+
+        // The method that was actually used
+        InputMethod method() const { return mapped ? InputMethod::MMAP : InputMethod::READ; }
+};
+
+//                                                  ---- Input Stream Classes ----
+/**
+ * @brief A source the Lexer can pull input from piece by piece (see Lexer(InputStream&, size_t))
+ */
+class InputStream {
+    public:
+        virtual ~InputStream() = default;
+
+        /**
+         * @brief Read up to size bytes into buffer, returns 0 only at the end of the input
+         */
+        virtual size_t read(char* buffer, size_t size) = 0;
+};
+
+/**
+ * @brief Streams a file with plain read() calls, whatever its size only the caller's buffer is used
+ */
+class FileStream : public InputStream {
+    private:
+        int fd;
+    public:
+        /**
+         * @brief Open the file, throws std::runtime_error if it cannot be opened
+         */
+        explicit FileStream(const std::string& path);
+        ~FileStream();
+
+        FileStream(const FileStream&) = delete;
+        FileStream& operator=(const FileStream&) = delete;
+
+        size_t read(char* buffer, size_t size) override;
+};
+
+/**
+ * @brief Reads another stream ahead on a dedicated thread, so reading overlaps with lexing
+ *
+ * The reader thread fills a ring of blockCount blocks of blockSize bytes (3 by default, so one
+ * can be consumed while the next is ready and another is being read) and read() hands them out
+ * in order. Time spent by each side waiting on the other is recorded: if the lexer mostly waits
+ * the input is the bottleneck, if the reader mostly waits parsing is.
+ * Errors from the source are rethrown by read().
+ */
+class ReadAheadStream : public InputStream {
+    public:
+        struct Stats {
+            size_t bytes;          // bytes read from the source
+            double readSeconds;    // time the reader spent inside source.read()
+            double readerStalled;  // time the reader waited for a free block (parsing is behind)
+            double consumerStalled; // time read() waited for a filled block (the input is behind)
+        };
+
+        ReadAheadStream(InputStream& source, size_t blockSize = 1024 * 1024, size_t blockCount = 3);
+        ~ReadAheadStream();
+
+        ReadAheadStream(const ReadAheadStream&) = delete;
+        ReadAheadStream& operator=(const ReadAheadStream&) = delete;
+
+        size_t read(char* buffer, size_t size) override;
+
+        /**
+         * @brief Counters so far (only final once read() has returned 0)
+         */
+        Stats stats() const;
+    private:
+        void run();
+
+        InputStream& source;
+        std::vector<std::vector<char>> blocks;
+        std::vector<size_t> filled;  // valid bytes of each block
+
+        // Shared with the reader thread, guarded by mutex
+        mutable std::mutex mutex;
+        std::condition_variable blockFilled;
+        std::condition_variable blockFreed;
+        size_t readyCount;   // filled blocks not yet fully consumed
+        bool finished;       // the source is exhausted (or failed)
+        bool stopping;
+        std::exception_ptr error;
+        Stats counters;
+
+        // Consumer side only
+        size_t head;         // block being consumed
+        size_t offset;       // position in it
+
+        std::thread reader;
+};
+
+#endif // JSON_INPUT_HPP
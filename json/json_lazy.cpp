@@ -0,0 +1,248 @@
+#include "json_lazy.hpp"
+#include "json_number.hpp"
+#include "json_structural.hpp"
+#include <cctype>
+#include <cstring>
+
+// Same token boundaries as Lexer::readNumber and Lexer::readKeyword
+static bool isNumberChar(char c) {
+    return (c >= '0' && c <= '9') || c == '.' || c == '-' || c == '+' || c == 'e' || c == 'E';
+}
+
+// What skipValue has to look at inside a container, everything else is skipped over
+enum BracketClass : uint8_t { OTHER, QUOTE, OPEN, CLOSE };
+static constexpr struct BracketClasses {
+    uint8_t table[256] = {};
+    constexpr BracketClasses() {
+        table[static_cast<unsigned char>('"')] = QUOTE;
+        table[static_cast<unsigned char>('{')] = OPEN;
+        table[static_cast<unsigned char>('[')] = OPEN;
+        table[static_cast<unsigned char>('}')] = CLOSE;
+        table[static_cast<unsigned char>(']')] = CLOSE;
+    }
+} BRACKET_CLASS;
+
+//                                                  ---- Lazy Document Implementation ----
+LazyDocument::LazyDocument(std::string_view input) : input(input) {
+    size_t begin = skipWhitespace(0);
+    if (begin == input.size()){
+        throw std::runtime_error("unexpected token when parsing value");
+    }
+    Node root = {begin, 0, 0, NOT_EXPANDED, 0, 0.0, 0, false};
+    char c = input[begin];
+    if (c != '{' && c != '['){
+        root.end = skipValue(begin);
+    }
+    nodes.push_back(root);
+}
+
+size_t LazyDocument::skipWhitespace(size_t position) const {
+    while (position < input.size() && isJsonWhitespace(input[position])){
+        ++position;
+    }
+    return position;
+}
+
+size_t LazyDocument::skipValue(size_t position) const {
+    char c = input[position];
+    if (c == '"'){
+        const void* quote = std::memchr(input.data() + position + 1, '"', input.size() - position - 1);
+        if (!quote){
+            throw std::runtime_error("Unterminated string");
+        }
+        return static_cast<const char*>(quote) - input.data() + 1;
+    }
+    if (c == '{' || c == '['){
+        // Bracket matching only, the content is checked if and when it is expanded
+        const char* at = input.data() + position;
+        const char* end = input.data() + input.size();
+        size_t depth = 0;
+        for (; at < end; ++at){
+            switch (BRACKET_CLASS.table[static_cast<unsigned char>(*at)]){
+                case QUOTE:
+                    // Strings are short, a plain loop beats calling memchr for each of them
+                    do {
+                        ++at;
+                    } while (at < end && *at != '"');
+                    if (at == end){
+                        throw std::runtime_error("Unterminated string");
+                    }
+                    break;
+                case OPEN:
+                    ++depth;
+                    break;
+                case CLOSE:
+                    if (--depth == 0){
+                        return at - input.data() + 1;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        throw std::runtime_error("Unexpected token: expected one type, got another");
+    }
+    size_t start = position;
+    if (std::isdigit(static_cast<unsigned char>(c)) || c == '-'){
+        while (position < input.size() && isNumberChar(input[position])){
+            ++position;
+        }
+    } else {
+        while (position < input.size() && std::isalpha(static_cast<unsigned char>(input[position]))){
+            ++position;
+        }
+    }
+    if (position == start){
+        throw std::runtime_error("unexpected token when parsing value");
+    }
+    return position;
+}
+
+void LazyDocument::expand(size_t index) {
+    // Children are appended to nodes, so no reference into it is kept across the loop
+    bool isObject = input[nodes[index].begin] == '{';
+    char close = isObject ? '}' : ']';
+    size_t first = nodes.size();
+    size_t position = skipWhitespace(nodes[index].begin + 1);
+
+    if (position < input.size() && input[position] == close){
+        ++position;
+    } else {
+        while (true){
+            Node child = {0, 0, 0, NOT_EXPANDED, 0, 0.0, 0, false};
+            if (isObject){
+                if (position >= input.size() || input[position] != '"'){
+                    throw std::runtime_error("expected string key");
+                }
+                size_t keyEnd = skipValue(position);
+                child.key = position + 1;
+                child.keyLength = static_cast<uint32_t>(keyEnd - position - 2);
+                position = skipWhitespace(keyEnd);
+                if (position >= input.size() || input[position] != ':'){
+                    throw std::runtime_error("Unexpected token: expected one type, got another");
+                }
+                position = skipWhitespace(position + 1);
+            }
+            if (position >= input.size()){
+                throw std::runtime_error("unexpected token when parsing value");
+            }
+            child.begin = position;
+            child.end = skipValue(position);
+            nodes.push_back(child);
+
+            position = skipWhitespace(child.end);
+            if (position < input.size() && input[position] == close){
+                ++position;
+                break;
+            }
+            if (position >= input.size() || input[position] != ','){
+                throw std::runtime_error("Unexpected token: expected one type, got another");
+            }
+            position = skipWhitespace(position + 1);
+        }
+    }
+    nodes[index].end = position;
+    nodes[index].first = first;
+    nodes[index].count = nodes.size() - first;
+}
+
+//                                                  ---- Lazy Value Implementation ----
+char LazyValue::type() const {
+    return doc->input[doc->nodes[node].begin];
+}
+
+std::string_view LazyValue::text() const {
+    LazyDocument::Node& n = doc->nodes[node];
+    if (n.end == 0){
+        n.end = doc->skipValue(n.begin);
+    }
+    return doc->input.substr(n.begin, n.end - n.begin);
+}
+
+LazyObject LazyValue::asObject() const {
+    if (!isObject()){
+        throw std::runtime_error("lazy value is not an object");
+    }
+    if (doc->nodes[node].first == LazyDocument::NOT_EXPANDED){
+        doc->expand(node);
+    }
+    const LazyDocument::Node& n = doc->nodes[node];
+    return LazyObject(doc, n.first, n.count);
+}
+
+LazyArray LazyValue::asArray() const {
+    if (!isArray()){
+        throw std::runtime_error("lazy value is not an array");
+    }
+    if (doc->nodes[node].first == LazyDocument::NOT_EXPANDED){
+        doc->expand(node);
+    }
+    const LazyDocument::Node& n = doc->nodes[node];
+    return LazyArray(doc, n.first, n.count);
+}
+
+std::string_view LazyValue::asString() const {
+    if (!isString()){
+        throw std::runtime_error("lazy value is not a string");
+    }
+    std::string_view raw = text();
+    return raw.substr(1, raw.size() - 2);
+}
+
+double LazyValue::asNumber() const {
+    if (!isNumber()){
+        throw std::runtime_error("lazy value is not a number");
+    }
+    LazyDocument::Node& n = doc->nodes[node];
+    if (!n.decoded){
+        // NOTE: same conversion as Parser::parseNumber so both give identical doubles
+        n.number = parseJsonNumber(text());
+        n.decoded = true;
+    }
+    return n.number;
+}
+
+bool LazyValue::asBool() const {
+    std::string_view raw = text();
+    if (raw == "true"){
+        return true;
+    }
+    if (raw == "false"){
+        return false;
+    }
+    throw std::runtime_error("lazy value is not a bool");
+}
+
+//                                                  ---- Lazy Array / Object Implementation ----
+LazyValue LazyArray::at(size_t index) const {
+    if (index >= size_){
+        throw std::out_of_range("array index out of range");
+    }
+    return LazyValue(doc, first_ + index);
+}
+
+LazyObject::Member LazyObject::iterator::operator*() const {
+    const LazyDocument::Node& n = doc->nodes[node];
+    return {doc->input.substr(n.key, n.keyLength), LazyValue(doc, node)};
+}
+
+size_t LazyObject::count(std::string_view key) const {
+    size_t result = 0;
+    for (Member member : *this){
+        if (member.key == key){
+            ++result;
+        }
+    }
+    return result;
+}
+
+LazyValue LazyObject::at(std::string_view key) const {
+    // Like std::map::operator[] in Parser, the last duplicate key wins
+    for (size_t index = first_ + size_; index > first_; --index){
+        const LazyDocument::Node& n = doc->nodes[index - 1];
+        if (doc->input.substr(n.key, n.keyLength) == key){
+            return LazyValue(doc, index - 1);
+        }
+    }
+    throw std::out_of_range("key not found in object");
+}
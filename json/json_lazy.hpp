@@ -0,0 +1,176 @@
+//     __ _____ _____ _____
+//  __|  |   __|     |   | |  Simple JSON
+// |  |  |__   |  |  | | | |  version 1.0.0
+// |_____|_____|_____|_|___|
+// Copyright (c) 2025, Muhammad Ahmed
+#ifndef JSON_LAZY_HPP
+#define JSON_LAZY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include <stdexcept>
+
+class LazyDocument;
+class LazyObject;
+class LazyArray;
+
+//                                                  ---- Lazy Value Class ----
+/**
+ * @brief A handle to a value of a LazyDocument, only decoded when it is asked for
+ * Like TapeValue it is two words big and is meant to be passed around by value, and like
+ * JsonValue the asX() methods throw if the type is not the expected one.
+ */
+class LazyValue {
+    private:
+        LazyDocument* doc;
+        size_t node;
+    public:
+        LazyValue(LazyDocument* doc, size_t node): doc(doc), node(node) {}
+
+        // The type is known from the first byte of the value, checking it decodes nothing
+        char type() const;
+        bool isObject() const { return type() == '{';}
+        bool isArray() const { return type() == '[';}
+        bool isString() const { return type() == '"';}
+        bool isNumber() const { return type() == '-' || (type() >= '0' && type() <= '9');}
+        bool isBool() const { return type() == 't' || type() == 'f';}
+        bool isNull() const { return type() == 'n';}
+
+        // Decoded (and for numbers cached) on first use
+        LazyObject asObject() const;
+        LazyArray asArray() const;
+        std::string_view asString() const;
+        double asNumber() const;
+        bool asBool() const;
+
+        /**
+         * @brief The raw JSON text of the value
+         */
+        std::string_view text() const;
+};
+
+/**
+ * @brief The elements of an array, found the first time the array is accessed
+ */
+class LazyArray {
+    private:
+        LazyDocument* doc;
+        size_t first_;
+        size_t size_;
+    public:
+        class iterator {
+            private:
+                LazyDocument* doc;
+                size_t node;
+            public:
+                iterator(LazyDocument* doc, size_t node): doc(doc), node(node) {}
+                LazyValue operator*() const { return LazyValue(doc, node); }
+                iterator& operator++() { ++node; return *this; }
+                bool operator!=(const iterator& other) const { return node != other.node; }
+        };
+
+        LazyArray(LazyDocument* doc, size_t first, size_t count): doc(doc), first_(first), size_(count) {}
+
+        iterator begin() const { return iterator(doc, first_); }
+        iterator end() const { return iterator(doc, first_ + size_); }
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+        LazyValue operator[](size_t index) const { return LazyValue(doc, first_ + index); }
+        LazyValue at(size_t index) const;
+};
+
+/**
+ * @brief The members of an object, found the first time the object is accessed
+ */
+class LazyObject {
+    private:
+        LazyDocument* doc;
+        size_t first_;
+        size_t size_;
+    public:
+        struct Member {
+            std::string_view key;
+            LazyValue value;
+        };
+
+        class iterator {
+            private:
+                LazyDocument* doc;
+                size_t node;
+            public:
+                iterator(LazyDocument* doc, size_t node): doc(doc), node(node) {}
+                Member operator*() const;
+                iterator& operator++() { ++node; return *this; }
+                bool operator!=(const iterator& other) const { return node != other.node; }
+        };
+
+        LazyObject(LazyDocument* doc, size_t first, size_t count): doc(doc), first_(first), size_(count) {}
+
+        iterator begin() const { return iterator(doc, first_); }
+        iterator end() const { return iterator(doc, first_ + size_); }
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+        // Linear scan over the keys, like Parser the last duplicate key wins
+        size_t count(std::string_view key) const;
+        LazyValue at(std::string_view key) const;
+};
+
+//                                                  ---- Lazy Document Class ----
+/**
+ * @brief A JSON document that is only parsed as far as it is accessed
+ *
+ * Opening the document only looks at the first byte of the root. Accessing an object or an array
+ * finds the position and type of its direct children, skipping over each child by bracket
+ * matching (strings are jumped over so brackets inside them do not count), and nothing deeper.
+ * Numbers and strings are decoded when asNumber()/asString() is called, with the same
+ * conversions as Parser, so every accessed value is identical to the eager one.
+ *
+ * The price is validation: only what has been accessed has been checked, a syntax error inside
+ * a subtree nobody touches (or after the root value) goes unnoticed.
+ * The input must outlive the document. A document (and its values) is not thread safe, because
+ * accessing a value can add nodes.
+ */
+class LazyDocument {
+    private:
+        friend class LazyValue;
+        friend class LazyObject;
+
+        static constexpr size_t NOT_EXPANDED = SIZE_MAX;
+
+        struct Node {
+            size_t begin;        // offset of the first byte of the value
+            size_t end;          // one past its last byte (0 until known)
+            size_t key;          // offset of the key when the value is an object member
+            size_t first;        // index of the first child node (NOT_EXPANDED until then)
+            size_t count;        // number of children once expanded
+            double number;       // valid once decoded
+            uint32_t keyLength;
+            bool decoded;
+        };
+
+        void expand(size_t index);
+        size_t skipValue(size_t position) const;
+        size_t skipWhitespace(size_t position) const;
+
+        std::string_view input;
+        std::vector<Node> nodes;
+    public:
+        /**
+         * @brief Wrap the input, nothing but the first byte of the root is read
+         * @param input The JSON text (not copied, it must outlive the document)
+         */
+        explicit LazyDocument(std::string_view input);
+
+        LazyValue root() { return LazyValue(this, 0); }
+
+        /**
+         * @brief Number of values that have been discovered so far
+         */
+        size_t nodeCount() const { return nodes.size(); }
+};
+
+#endif // JSON_LAZY_HPP
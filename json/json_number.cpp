@@ -0,0 +1,339 @@
+#include "json_number.hpp"
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+//                                                  ---- Powers of five ----
+// Eisel-Lemire needs 5^q for q in [-342, 308] as normalized 128 bit mantissas: the top 128 bits
+// of 5^q, and for negative q, floor(2^b / 5^-q) + 1 truncated to 128 bits (b chosen as in the
+// reference fast_float implementation so that the truncation error stays below one ulp).
+// The table is computed at compile time with a small fixed size big integer.
+static constexpr int POW10_MIN = -342;
+static constexpr int POW10_MAX = 308;
+
+namespace {
+
+struct BigInt {
+    static constexpr int LIMBS = 56; // 1792 bits, enough for 2^1728 / 5^n and 5^342
+    uint32_t limb[LIMBS];
+
+    constexpr BigInt() : limb() {}
+
+    constexpr void multiplySmall(uint32_t factor) {
+        uint64_t carry = 0;
+        for (int i = 0; i < LIMBS; ++i){
+            uint64_t value = static_cast<uint64_t>(limb[i]) * factor + carry;
+            limb[i] = static_cast<uint32_t>(value);
+            carry = value >> 32;
+        }
+    }
+
+    constexpr void divideSmall(uint32_t divisor) {
+        uint64_t remainder = 0;
+        for (int i = LIMBS - 1; i >= 0; --i){
+            uint64_t value = (remainder << 32) | limb[i];
+            limb[i] = static_cast<uint32_t>(value / divisor);
+            remainder = value % divisor;
+        }
+    }
+
+    constexpr void addOne() {
+        for (int i = 0; i < LIMBS; ++i){
+            if (++limb[i] != 0){
+                return;
+            }
+        }
+    }
+
+    constexpr int bitLength() const {
+        for (int i = LIMBS - 1; i >= 0; --i){
+            if (limb[i]){
+                int bits = 32;
+                while (!(limb[i] >> (bits - 1))){
+                    --bits;
+                }
+                return 32*i + bits;
+            }
+        }
+        return 0;
+    }
+
+    constexpr bool bit(int index) const {
+        return index >= 0 && index < 32*LIMBS && ((limb[index / 32] >> (index % 32)) & 1);
+    }
+
+    constexpr BigInt shiftedRight(int shift) const {
+        BigInt result;
+        int limbShift = shift / 32;
+        int bitShift = shift % 32;
+        for (int i = 0; i + limbShift < LIMBS; ++i){
+            uint64_t low = limb[i + limbShift];
+            uint64_t high = (i + limbShift + 1 < LIMBS) ? limb[i + limbShift + 1] : 0;
+            result.limb[i] = static_cast<uint32_t>(((high << 32) | low) >> bitShift);
+        }
+        return result;
+    }
+
+    // Most significant bit moved to bit 127, lower bits truncated
+    constexpr void top128(uint64_t& high, uint64_t& low) const {
+        int top = bitLength() - 1;
+        high = 0;
+        low = 0;
+        for (int i = 0; i < 128; ++i){
+            if (bit(top - i)){
+                if (i < 64){
+                    high |= 1ULL << (63 - i);
+                } else {
+                    low |= 1ULL << (127 - i);
+                }
+            }
+        }
+    }
+};
+
+struct PowersOfFive {
+    uint64_t entries[2 * (POW10_MAX - POW10_MIN + 1)];
+
+    constexpr PowersOfFive() : entries() {
+        constexpr int B = 1728;
+        // power = 5^n, quotient = floor(2^B / 5^n); floor(floor(x / 5) / 5) == floor(x / 25) keeps it exact
+        BigInt power;
+        power.limb[0] = 1;
+        BigInt quotient;
+        quotient.limb[B / 32] = 1u << (B % 32);
+
+        power.top128(entries[2*(0 - POW10_MIN)], entries[2*(0 - POW10_MIN) + 1]);
+        for (int n = 1; n <= -POW10_MIN; ++n){
+            power.multiplySmall(5);
+            quotient.divideSmall(5);
+            if (n <= POW10_MAX){
+                power.top128(entries[2*(n - POW10_MIN)], entries[2*(n - POW10_MIN) + 1]);
+            }
+            int z = power.bitLength(); // 2^z > 5^n since 5^n is never a power of two
+            int b = (n <= 27) ? z + 127 : 2*z + 128;
+            BigInt reciprocal = quotient.shiftedRight(B - b); // floor(2^b / 5^n)
+            reciprocal.addOne();
+            reciprocal.top128(entries[2*(-n - POW10_MIN)], entries[2*(-n - POW10_MIN) + 1]);
+        }
+    }
+};
+
+constexpr PowersOfFive POWERS_OF_FIVE;
+
+constexpr double EXACT_POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+} // namespace
+
+//                                                  ---- Eisel-Lemire ----
+// Returns false if the result cannot be decided from the 128 bit approximation
+static bool eiselLemire(uint64_t mantissa, int64_t exponent, uint64_t& bits) {
+    constexpr int MANTISSA_BITS = 52;
+    constexpr int MINIMUM_EXPONENT = -1023;
+
+    int leadingZeros = __builtin_clzll(mantissa);
+    mantissa <<= leadingZeros;
+
+    // mantissa * 5^exponent, keeping the top 128 bits (a second multiplication is only needed
+    // if the bits that decide the rounding might still change)
+    size_t index = 2 * static_cast<size_t>(exponent - POW10_MIN);
+    unsigned __int128 first = static_cast<unsigned __int128>(mantissa) * POWERS_OF_FIVE.entries[index];
+    uint64_t high = static_cast<uint64_t>(first >> 64);
+    uint64_t low = static_cast<uint64_t>(first);
+    constexpr uint64_t PRECISION_MASK = 0xFFFFFFFFFFFFFFFFULL >> (MANTISSA_BITS + 3);
+    if ((high & PRECISION_MASK) == PRECISION_MASK){
+        unsigned __int128 second = static_cast<unsigned __int128>(mantissa) * POWERS_OF_FIVE.entries[index + 1];
+        uint64_t secondHigh = static_cast<uint64_t>(second >> 64);
+        low += secondHigh;
+        if (secondHigh > low){
+            ++high;
+        }
+        if (low == 0xFFFFFFFFFFFFFFFFULL && (exponent < -27 || exponent > 55)){
+            return false;
+        }
+    }
+
+    int upperBit = static_cast<int>(high >> 63);
+    int shift = upperBit + 64 - MANTISSA_BITS - 3;
+    uint64_t resultMantissa = high >> shift;
+    // floor(exponent * log2(10)) + 63
+    int32_t power2 = static_cast<int32_t>(((152170 + 65536) * exponent) >> 16) + 63 + upperBit - leadingZeros - MINIMUM_EXPONENT;
+
+    if (power2 <= 0){
+        // Subnormal
+        if (-power2 + 1 >= 64){
+            bits = 0;
+            return true;
+        }
+        resultMantissa >>= -power2 + 1;
+        resultMantissa += (resultMantissa & 1);
+        resultMantissa >>= 1;
+        power2 = (resultMantissa < (1ULL << MANTISSA_BITS)) ? 0 : 1;
+        bits = (static_cast<uint64_t>(power2) << MANTISSA_BITS) | (resultMantissa & ((1ULL << MANTISSA_BITS) - 1));
+        return true;
+    }
+
+    // We round up unless we are exactly halfway and the result is already even
+    if (low <= 1 && exponent >= -4 && exponent <= 23 && (resultMantissa & 3) == 1){
+        if ((resultMantissa << shift) == high){
+            resultMantissa &= ~1ULL;
+        }
+    }
+    resultMantissa += (resultMantissa & 1);
+    resultMantissa >>= 1;
+    if (resultMantissa >= (2ULL << MANTISSA_BITS)){
+        resultMantissa = 1ULL << MANTISSA_BITS;
+        ++power2;
+    }
+    resultMantissa &= ~(1ULL << MANTISSA_BITS);
+    if (power2 >= 0x7FF){
+        bits = 0x7FFULL << MANTISSA_BITS;
+        return true;
+    }
+    bits = (static_cast<uint64_t>(power2) << MANTISSA_BITS) | resultMantissa;
+    return true;
+}
+
+//                                                  ---- Number Parsing ----
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// SWAR: check and convert 8 ASCII digits at once (little endian)
+static bool isEightDigits(const char* p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return !(((value + 0x4646464646464646ULL) | (value - 0x3030303030303030ULL)) & 0x8080808080808080ULL);
+}
+
+static uint64_t parseEightDigits(const char* p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    value -= 0x3030303030303030ULL;
+    value = (value * 10) + (value >> 8);
+    value = (((value & 0x000000FF000000FFULL) * 0x000F424000000064ULL) +
+             (((value >> 16) & 0x000000FF000000FFULL) * 0x0000271000000001ULL)) >> 32;
+    return static_cast<uint32_t>(value);
+}
+
+static double slowPath(std::string_view text) {
+    double value = 0;
+    std::from_chars_result result = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (result.ec == std::errc::result_out_of_range){
+        throw std::out_of_range("number out of range: " + std::string(text));
+    }
+    if (result.ec != std::errc() || result.ptr != text.data() + text.size()){
+        throw std::invalid_argument("invalid number: " + std::string(text));
+    }
+    return value;
+}
+
+double parseJsonNumber(std::string_view text) {
+    const char* p = text.data();
+    const char* end = p + text.size();
+
+    bool negative = false;
+    if (p != end && *p == '-'){
+        negative = true;
+        ++p;
+    }
+
+    // Up to 19 significant digits fit in a uint64_t. Leading zeros are not significant, they only
+    // move the decimal point.
+    uint64_t mantissa = 0;
+    int64_t exponent = 0;
+
+    const char* integerStart = p;
+    while (p != end && *p == '0'){
+        ++p;
+    }
+    const char* significantStart = p;
+    for (; p != end && isDigit(*p); ++p){
+        mantissa = mantissa*10 + static_cast<uint64_t>(*p - '0');
+    }
+    size_t digitCount = p - integerStart;
+    size_t significantDigits = p - significantStart;
+
+    if (p != end && *p == '.'){
+        ++p;
+        const char* fractionStart = p;
+        if (significantDigits == 0){
+            while (p != end && *p == '0'){
+                ++p;
+            }
+        }
+        const char* fractionSignificant = p;
+        while (end - p >= 8 && isEightDigits(p)){
+            mantissa = mantissa*100000000 + parseEightDigits(p);
+            p += 8;
+        }
+        for (; p != end && isDigit(*p); ++p){
+            mantissa = mantissa*10 + static_cast<uint64_t>(*p - '0');
+        }
+        exponent = -(p - fractionStart);
+        digitCount += p - fractionStart;
+        significantDigits += p - fractionSignificant;
+    }
+    if (digitCount == 0){
+        throw std::invalid_argument("invalid number: " + std::string(text));
+    }
+    if (p != end && (*p == 'e' || *p == 'E')){
+        ++p;
+        bool negativeExponent = false;
+        if (p != end && (*p == '-' || *p == '+')){
+            negativeExponent = (*p == '-');
+            ++p;
+        }
+        if (p == end || !isDigit(*p)){
+            throw std::invalid_argument("invalid number: " + std::string(text));
+        }
+        int64_t explicitExponent = 0;
+        for (; p != end && isDigit(*p); ++p){
+            // Saturate, anything this large is out of range anyway
+            if (explicitExponent < 100000){
+                explicitExponent = explicitExponent*10 + (*p - '0');
+            }
+        }
+        exponent += negativeExponent ? -explicitExponent : explicitExponent;
+    }
+    if (p != end){
+        throw std::invalid_argument("invalid number: " + std::string(text));
+    }
+
+    if (significantDigits > 19){
+        return slowPath(text);
+    }
+    if (mantissa == 0){
+        return negative ? -0.0 : 0.0;
+    }
+
+    // Clinger: both the mantissa and the power of ten are exact doubles, so one IEEE operation
+    // gives the correctly rounded result
+    if (exponent >= -22 && exponent <= 22 && mantissa <= (1ULL << 53)){
+        double value = static_cast<double>(mantissa);
+        value = (exponent < 0) ? value / EXACT_POWERS_OF_TEN[-exponent] : value * EXACT_POWERS_OF_TEN[exponent];
+        return negative ? -value : value;
+    }
+
+    if (exponent < POW10_MIN || exponent > POW10_MAX){
+        // 19 digits times 10^-343 rounds to zero and times 10^309 is infinite
+        throw std::out_of_range("number out of range: " + std::string(text));
+    }
+    uint64_t bits;
+    if (!eiselLemire(mantissa, exponent, bits)){
+        return slowPath(text);
+    }
+    if (bits == 0 || bits == (0x7FFULL << 52)){
+        throw std::out_of_range("number out of range: " + std::string(text));
+    }
+    if (negative){
+        bits |= 1ULL << 63;
+    }
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
@@ -0,0 +1,25 @@
+//     __ _____ _____ _____
+//  __|  |   __|     |   | |  Simple JSON
+// |  |  |__   |  |  | | | |  version 1.0.0
+// |_____|_____|_____|_|___|
+// Copyright (c) 2025, Muhammad Ahmed
+#ifndef JSON_NUMBER_HPP
+#define JSON_NUMBER_HPP
+
+#include <string_view>
+
+/**
+ * @brief Convert the text of a NUMBER token to the nearest double, without allocating
+ *
+ * Accepts [-](digits[.digits*] | .digits)[(e|E)[+|-]digits], the same decimal forms std::stod
+ * does, and always rounds to nearest (ties to even) independent of the locale.
+ * Up to 19 significant digits it uses Clinger's fast path (exact when both the mantissa and the
+ * power of ten fit in a double) and otherwise the Eisel-Lemire algorithm. Inputs neither can
+ * decide (more digits, extreme exponents, rare halfway cases) go through std::from_chars.
+ *
+ * Throws std::invalid_argument if the whole text is not a number and std::out_of_range if it
+ * overflows to infinity (or underflows to zero), like std::stod.
+ */
+double parseJsonNumber(std::string_view text);
+
+#endif // JSON_NUMBER_HPP
@@ -0,0 +1,275 @@
+#include "json_object.hpp"
+#include "json_parser.hpp"
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+
+//                                                  ---- JSON Key Implementation ----
+uint64_t JsonKey::hash(std::string_view text) {
+    // FNV-1a, keys are short
+    uint64_t h = 14695981039346656037ULL;
+    for (char c : text){
+        h = (h ^ static_cast<uint8_t>(c)) * 1099511628211ULL;
+    }
+    return h;
+}
+
+JsonKey JsonKey::intern(std::string_view text) {
+    return intern(text, hash(text));
+}
+
+size_t JsonKey::entryBytes(size_t length) {
+    return (sizeof(Entry) + length + alignof(Entry) - 1) & ~(alignof(Entry) - 1);
+}
+
+JsonKey::Entry* JsonKey::makeEntry(std::string_view text, uint64_t hash, void* memory) {
+    Entry* entry = static_cast<Entry*>(memory);
+    entry->hash = hash;
+    entry->length = text.size();
+    std::copy(text.begin(), text.end(), reinterpret_cast<char*>(entry + 1));
+    return entry;
+}
+
+JsonKey JsonKey::intern(std::string_view text, uint64_t hash) {
+    // Open addressing table of entries, the entries themselves are bump allocated from blocks
+    // that are never freed (so a pooled JsonKey stays valid for the life of the process)
+    struct Pool {
+        std::mutex mutex;
+        std::vector<const Entry*> table = std::vector<const Entry*>(1024, nullptr);
+        size_t count = 0;
+        char* block = nullptr;
+        size_t left = 0;
+    };
+    static constexpr size_t BLOCK_BYTES = 64 * 1024;
+    static Pool pool;
+
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    size_t mask = pool.table.size() - 1;
+    size_t slot = hash & mask;
+    for (; pool.table[slot]; slot = (slot + 1) & mask){
+        const Entry* entry = pool.table[slot];
+        if (entry->hash == hash && JsonKey(entry).view() == text){
+            return JsonKey(entry);
+        }
+    }
+    if (pool.count == MAX_POOLED){
+        return JsonKey();
+    }
+
+    size_t bytes = entryBytes(text.size());
+    if (bytes > pool.left){
+        size_t blockBytes = std::max(BLOCK_BYTES, bytes);
+        pool.block = new char[blockBytes];
+        pool.left = blockBytes;
+    }
+    Entry* entry = makeEntry(text, hash, pool.block);
+    pool.block += bytes;
+    pool.left -= bytes;
+
+    pool.table[slot] = entry;
+    if (++pool.count * 2 > pool.table.size()){
+        std::vector<const Entry*> grown(2 * pool.table.size(), nullptr);
+        size_t grownMask = grown.size() - 1;
+        for (const Entry* old : pool.table){
+            if (old){
+                size_t index = old->hash & grownMask;
+                while (grown[index]){
+                    index = (index + 1) & grownMask;
+                }
+                grown[index] = old;
+            }
+        }
+        pool.table.swap(grown);
+    }
+    return JsonKey(entry);
+}
+
+JsonKey JsonKeyCache::intern(std::string_view text) {
+    uint64_t hash = JsonKey::hash(text);
+    const JsonKey::Entry*& slot = slots[hash & (SLOTS - 1)];
+    if (slot && slot->hash == hash && JsonKey(slot).view() == text){
+        return JsonKey(slot);
+    }
+    JsonKey key = JsonKey::intern(text, hash);
+    if (key){
+        slot = key.entry();
+    }
+    return key;
+}
+
+//                                                  ---- JSON Object Implementation ----
+// Slots of the hash index for an object of the given size (0: no index, linear search)
+static size_t indexCapacity(size_t size) {
+    if (size <= JsonObject::HASH_THRESHOLD){
+        return 0;
+    }
+    size_t capacity = 64;
+    while (capacity < 2*size){
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+// A key this object owns, for keys the pool has no room for
+JsonKey JsonObject::ownKey(std::string_view key, uint64_t hash) {
+    return JsonKey(JsonKey::makeEntry(key, hash, new char[JsonKey::entryBytes(key.size())]), true);
+}
+
+// Pooled keys are shared, owned keys are copied
+JsonKey JsonObject::copyKey(JsonKey key) {
+    return key.owned() ? ownKey(key.view(), key.hashValue()) : key;
+}
+
+void JsonObject::freeKeys(std::vector<JsonKey>& keys) {
+    for (JsonKey key : keys){
+        if (key.owned()){
+            delete[] reinterpret_cast<const char*>(key.entry());
+        }
+    }
+    keys.clear();
+}
+
+JsonObject::JsonObject() = default;
+JsonObject::JsonObject(JsonObject&& other) noexcept = default;
+
+JsonObject::~JsonObject() {
+    freeKeys(keys);
+}
+
+JsonObject& JsonObject::operator=(JsonObject&& other) noexcept {
+    if (this != &other){
+        freeKeys(keys);
+        keys = std::move(other.keys);
+        values = std::move(other.values);
+        index = std::move(other.index);
+    }
+    return *this;
+}
+
+JsonObject::JsonObject(const JsonObject& other) : values(other.values) {
+    keys.reserve(other.keys.size());
+    for (JsonKey key : other.keys){
+        keys.push_back(copyKey(key));
+    }
+    rebuildIndex();
+}
+
+JsonObject& JsonObject::operator=(const JsonObject& other) {
+    if (this != &other){
+        JsonObject copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+JsonObject::Member JsonObject::iterator::operator*() const {
+    return {object->keys[position].view(), object->values[position]};
+}
+
+size_t JsonObject::probe(std::string_view key, uint64_t hash) const {
+    size_t mask = indexCapacity(keys.size()) - 1;
+    for (size_t slot = hash & mask; index[slot]; slot = (slot + 1) & mask){
+        size_t position = index[slot] - 1;
+        if (keys[position].hashValue() == hash && keys[position].view() == key){
+            return position;
+        }
+    }
+    return NOT_FOUND;
+}
+
+size_t JsonObject::find(std::string_view key) const {
+    if (index){
+        return probe(key, JsonKey::hash(key));
+    }
+    for (size_t position = 0; position < keys.size(); ++position){
+        if (keys[position].view() == key){
+            return position;
+        }
+    }
+    return NOT_FOUND;
+}
+
+size_t JsonObject::find(JsonKey key) const {
+    if (index){
+        return probe(key.view(), key.hashValue());
+    }
+    // Pooled keys are equal exactly when their pointers are (a key the pool has no room for is never pooled later)
+    for (size_t position = 0; position < keys.size(); ++position){
+        if (keys[position] == key){
+            return position;
+        }
+    }
+    return NOT_FOUND;
+}
+
+void JsonObject::insertIndex(size_t position) {
+    size_t mask = indexCapacity(keys.size()) - 1;
+    size_t slot = keys[position].hashValue() & mask;
+    while (index[slot]){
+        slot = (slot + 1) & mask;
+    }
+    index[slot] = static_cast<uint32_t>(position + 1);
+}
+
+void JsonObject::rebuildIndex() {
+    size_t capacity = indexCapacity(keys.size());
+    if (capacity == 0){
+        index.reset();
+        return;
+    }
+    index.reset(new uint32_t[capacity]());
+    for (size_t position = 0; position < keys.size(); ++position){
+        insertIndex(position);
+    }
+}
+
+const JsonValue& JsonObject::at(std::string_view key) const {
+    size_t position = find(key);
+    if (position == NOT_FOUND){
+        throw std::out_of_range("key not found in object");
+    }
+    return values[position];
+}
+
+JsonValue& JsonObject::at(std::string_view key) {
+    size_t position = find(key);
+    if (position == NOT_FOUND){
+        throw std::out_of_range("key not found in object");
+    }
+    return values[position];
+}
+
+JsonValue& JsonObject::operator[](std::string_view key) {
+    size_t position = find(key);
+    if (position != NOT_FOUND){
+        return values[position];
+    }
+    uint64_t hash = JsonKey::hash(key);
+    JsonKey pooled = JsonKey::intern(key, hash);
+    if (pooled){
+        return insert(pooled);
+    }
+    // The pool is full, this object keeps the key itself
+    return insert(ownKey(key, hash));
+}
+
+JsonValue& JsonObject::operator[](JsonKey key) {
+    size_t position = find(key);
+    if (position != NOT_FOUND){
+        return values[position];
+    }
+    return insert(key);
+}
+
+JsonValue& JsonObject::insert(JsonKey key) {
+    size_t before = indexCapacity(keys.size());
+    keys.push_back(key);
+    values.emplace_back();
+    if (indexCapacity(keys.size()) != before){
+        rebuildIndex();
+    } else if (index){
+        insertIndex(keys.size() - 1);
+    }
+    return values.back();
+}
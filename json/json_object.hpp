@@ -0,0 +1,159 @@
+//     __ _____ _____ _____
+//  __|  |   __|     |   | |  Simple JSON
+// |  |  |__   |  |  | | | |  version 1.0.0
+// |_____|_____|_____|_|___|
+// Copyright (c) 2025, Muhammad Ahmed
+#ifndef JSON_OBJECT_HPP
+#define JSON_OBJECT_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+class JsonValue;
+
+//                                                  ---- JSON Key Class ----
+/**
+ * @brief An object key, interned in a process wide pool
+ *
+ * Equal pooled keys share a single copy of their bytes, so a JsonKey is one pointer and two
+ * pooled keys are equal exactly when the pointers are. The pool is never freed, so it only takes
+ * the first MAX_POOLED distinct keys the process sees, which covers the field names of any
+ * reasonable schema. Once it is full, keys that are not in it yet (ids used as keys, for example)
+ * are not pooled: each JsonObject keeps its own copy of them and frees it with the object, so
+ * they are released with the document instead of growing the pool without bound.
+ * Interning is thread safe.
+ */
+class JsonKey {
+    private:
+        friend class JsonKeyCache;
+        friend class JsonObject;
+
+        // The key's bytes follow the entry
+        struct Entry {
+            uint64_t hash;
+            size_t length;
+        };
+
+        // Entry pointer, with the low bit set if the entry is owned by a JsonObject rather than pooled
+        uintptr_t bits;
+
+        explicit JsonKey(const Entry* entry, bool owned = false)
+            : bits(reinterpret_cast<uintptr_t>(entry) | static_cast<uintptr_t>(owned)) {}
+        const Entry* entry() const { return reinterpret_cast<const Entry*>(bits & ~uintptr_t(1)); }
+        bool owned() const { return bits & 1; }
+
+        static Entry* makeEntry(std::string_view text, uint64_t hash, void* memory);
+        static size_t entryBytes(size_t length);
+    public:
+        // Distinct keys the pool holds at most
+        static constexpr size_t MAX_POOLED = 4096;
+
+        JsonKey() : bits(0) {}
+
+        /**
+         * @brief The pooled key equal to text (added to the pool the first time)
+         * Returns an empty key if text is not pooled and the pool is full.
+         */
+        static JsonKey intern(std::string_view text);
+        static JsonKey intern(std::string_view text, uint64_t hash);
+
+        static uint64_t hash(std::string_view text);
+
+        explicit operator bool() const { return bits != 0; }
+
+        std::string_view view() const { return std::string_view(reinterpret_cast<const char*>(entry() + 1), entry()->length); }
+        uint64_t hashValue() const { return entry()->hash; }
+
+        bool operator==(JsonKey other) const { return bits == other.bits; }
+        bool operator!=(JsonKey other) const { return bits != other.bits; }
+};
+
+/**
+ * @brief A small direct mapped cache in front of JsonKey::intern for one parser (one thread)
+ * Documents repeat the same few keys over and over, so almost every lookup hits here without
+ * touching the shared pool and its lock.
+ */
+class JsonKeyCache {
+    private:
+        static constexpr size_t SLOTS = 256;
+        std::array<const JsonKey::Entry*, SLOTS> slots{};
+    public:
+        // Same as JsonKey::intern (so it can return an empty key)
+        JsonKey intern(std::string_view text);
+};
+
+//                                                  ---- JSON Object Class ----
+/**
+ * @brief Keys and values of a JSON object in two contiguous arrays, in insertion order
+ *
+ * Small objects (the common case) are searched linearly, which only touches the key array.
+ * Above HASH_THRESHOLD members an open addressing index over the keys is kept as well.
+ * Like std::map::operator[], assigning to an existing key replaces its value (so the last
+ * duplicate key of a document wins), and at() throws std::out_of_range for missing keys.
+ * Keys the JsonKey pool has no room for are copied into the object and freed with it.
+ */
+class JsonObject {
+    private:
+        static constexpr size_t NOT_FOUND = SIZE_MAX;
+
+        size_t find(std::string_view key) const;
+        size_t find(JsonKey key) const;
+        size_t probe(std::string_view key, uint64_t hash) const;
+        JsonValue& insert(JsonKey key);
+        static JsonKey ownKey(std::string_view key, uint64_t hash);
+        static JsonKey copyKey(JsonKey key);
+        static void freeKeys(std::vector<JsonKey>& keys);
+        void insertIndex(size_t position);
+        void rebuildIndex();
+
+        std::vector<JsonKey> keys;
+        std::vector<JsonValue> values;
+        // position + 1 of each key (0 is empty), capacity is indexCapacity(keys.size())
+        std::unique_ptr<uint32_t[]> index;
+    public:
+        static constexpr size_t HASH_THRESHOLD = 16;
+
+        struct Member {
+            std::string_view key;
+            const JsonValue& value;
+        };
+
+        class iterator {
+            private:
+                const JsonObject* object;
+                size_t position;
+            public:
+                iterator(const JsonObject* object, size_t position): object(object), position(position) {}
+                Member operator*() const;
+                iterator& operator++() { ++position; return *this; }
+                bool operator!=(const iterator& other) const { return position != other.position; }
+        };
+
+        JsonObject();
+        ~JsonObject();
+        JsonObject(const JsonObject& other);
+        JsonObject(JsonObject&& other) noexcept;
+        JsonObject& operator=(const JsonObject& other);
+        JsonObject& operator=(JsonObject&& other) noexcept;
+
+        size_t size() const { return keys.size(); }
+        bool empty() const { return keys.empty(); }
+
+        iterator begin() const { return iterator(this, 0); }
+        iterator end() const { return iterator(this, keys.size()); }
+
+        size_t count(std::string_view key) const { return find(key) != NOT_FOUND; }
+        const JsonValue& at(std::string_view key) const;
+        JsonValue& at(std::string_view key);
+
+        // Insert a null value if the key is missing
+        JsonValue& operator[](std::string_view key);
+        // key must not be empty
+        JsonValue& operator[](JsonKey key);
+};
+
+#endif // JSON_OBJECT_HPP
@@ -0,0 +1,253 @@
+#include "json_parallel.hpp"
+#include "../profiler/Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// A Lexer and a Parser that start at input[offset], their tokens still point into the whole input
+struct Cursor {
+    Lexer lexer;
+    Parser parser;
+
+    Cursor(std::string_view input, size_t offset, StructuralBackend backend)
+        : lexer(input.substr(offset), backend), parser(lexer) {}
+};
+
+// One slice of an array, parsed by one thread
+struct Chunk {
+    size_t start = 0;      // offset of the first element
+    size_t limit = 0;      // offset where the next chunk starts (npos for the last chunk)
+    JsonArray elements;
+    size_t stop = 0;       // offset of the first element that was left to the next chunk
+    size_t end = 0;        // offset just past the ']' if this chunk reached the end of the array
+    bool reachedEnd = false;
+    bool failed = false;
+};
+
+} // namespace
+
+// Longest "{ "key":" prefix used to recognize where an object element starts
+static constexpr size_t MAX_HEAD_BYTES = 256;
+
+static size_t offsetOf(std::string_view input, const Token& token) {
+    return static_cast<size_t>(token.value.data() - input.data());
+}
+
+// Parse elements until one starts at or after chunk.limit, or the array ends.
+// Chunks after the one holding the end of the array are not needed, lastChunk lets them give up early.
+static void parseChunk(std::string_view input, StructuralBackend backend, Chunk& chunk, size_t index, std::atomic<size_t>& lastChunk) {
+    try {
+        Cursor cursor(input, chunk.start, backend);
+        while (lastChunk.load(std::memory_order_relaxed) >= index){
+            chunk.elements.push_back(cursor.parser.parseNext());
+            const Token& token = cursor.parser.peek();
+            if (token.type == TokenType::RBRACKET){
+                chunk.reachedEnd = true;
+                chunk.end = offsetOf(input, token) + 1;
+                size_t current = lastChunk.load();
+                while (index < current && !lastChunk.compare_exchange_weak(current, index)) {}
+                return;
+            }
+            cursor.parser.consume(TokenType::COMMA);
+            size_t next = offsetOf(input, cursor.parser.peek());
+            if (next >= chunk.limit){
+                chunk.stop = next;
+                return;
+            }
+        }
+    } catch (const std::exception&) {
+        // A chunk that started on a wrong guess usually ends up here, the caller decides what it means
+    }
+    chunk.failed = true;
+}
+
+//                                                  ---- Parallel Parser Implementation ----
+ParallelParser::ParallelParser(std::string_view input, unsigned threadCount, StructuralBackend backend)
+    : input(input), threadCount(threadCount), backend(backend), chunksUsed(1) {}
+
+JsonValue ParallelParser::parse(){
+    PROFILE_BANDWIDTH("Parse JSON", input.size());
+    chunksUsed = 1;
+    if (threadCount > 1 && input.size() >= 2*MIN_CHUNK_BYTES){
+        try {
+            JsonValue result;
+            if (parseSplit(result)){
+                return result;
+            }
+        } catch (const std::exception&) {
+            // Fall through, the serial parser throws the error Parser would
+        }
+    }
+    chunksUsed = 1;
+    Lexer lexer(input, backend);
+    Parser parser(lexer);
+    return parser.parse();
+}
+
+bool ParallelParser::parseSplit(JsonValue& result){
+    std::optional<Cursor> cursor;
+    cursor.emplace(input, 0, backend);
+
+    if (cursor->parser.peek().type == TokenType::LBRACKET){
+        size_t end = 0;
+        if (!parseArray(offsetOf(input, cursor->parser.peek()), result, end)){
+            return false;
+        }
+        cursor.emplace(input, end, backend);
+    } else if (cursor->parser.peek().type == TokenType::LBRACE){
+        // Same steps as Parser::parseObject, except that array members may be split
+        cursor->parser.consume(TokenType::LBRACE);
+        JsonObject obj;
+        if (cursor->parser.peek().type != TokenType::RBRACE){
+            while (true){
+                if (cursor->parser.peek().type != TokenType::STRING){
+                    return false;
+                }
+                std::string key = cursor->parser.peek().str();
+                cursor->parser.consume(TokenType::STRING);
+                cursor->parser.consume(TokenType::COLON);
+                if (cursor->parser.peek().type == TokenType::LBRACKET){
+                    size_t end = 0;
+                    if (!parseArray(offsetOf(input, cursor->parser.peek()), obj[key], end)){
+                        return false;
+                    }
+                    cursor.emplace(input, end, backend);
+                } else {
+                    obj[key] = cursor->parser.parseNext();
+                }
+                if (cursor->parser.peek().type == TokenType::RBRACE){
+                    break;
+                }
+                cursor->parser.consume(TokenType::COMMA);
+            }
+        }
+        cursor->parser.consume(TokenType::RBRACE);
+        result = JsonValue(std::move(obj));
+    } else {
+        return false;
+    }
+    return cursor->parser.peek().type == TokenType::EOF_T;
+}
+
+size_t ParallelParser::findBoundary(size_t from, std::string_view head) const {
+    // Elements that are objects (arrays) are separated by "},{" ("],["), scalars by a ',' alone.
+    // head is how the first element starts (up to its first key for objects), which rules out
+    // most of the "},{" that are nested inside an element.
+    char first = head.empty() ? 0 : head[0];
+    char close = (first == '{') ? '}' : (first == '[') ? ']' : 0;
+    for (size_t i = from; i < input.size(); ++i){
+        if (input[i] != ','){
+            continue;
+        }
+        if (close){
+            size_t before = i;
+            while (before > 0 && isJsonWhitespace(input[before - 1])){
+                --before;
+            }
+            if (before == 0 || input[before - 1] != close){
+                continue;
+            }
+        }
+        size_t after = i + 1;
+        while (after < input.size() && isJsonWhitespace(input[after])){
+            ++after;
+        }
+        if (after == input.size()){
+            break;
+        }
+        char c = input[after];
+        bool structural = (c == '{' || c == '}' || c == '[' || c == ']' || c == ',' || c == ':');
+        if (close ? input.substr(after, head.size()) == head : !structural){
+            return after;
+        }
+    }
+    return std::string_view::npos;
+}
+
+bool ParallelParser::parseArray(size_t start, JsonValue& result, size_t& end){
+    // start is the offset of the '['
+    size_t first = start + 1;
+    while (first < input.size() && isJsonWhitespace(input[first])){
+        ++first;
+    }
+    // We do not know where the array ends, only that it cannot go past the end of the input
+    size_t available = input.size() - std::min(first, input.size());
+    size_t chunkCount = std::min<size_t>(threadCount, available / MIN_CHUNK_BYTES);
+
+    std::vector<Chunk> chunks;
+    if (chunkCount > 1 && input[first] != ']'){
+        std::string_view head = input.substr(first, 1);
+        if (head == "{"){
+            size_t colon = input.find(':', first);
+            if (colon != std::string_view::npos && colon - first < MAX_HEAD_BYTES){
+                head = input.substr(first, colon + 1 - first);
+            }
+        }
+        chunks.emplace_back();
+        chunks.back().start = first;
+        for (size_t k = 1; k < chunkCount; ++k){
+            size_t boundary = findBoundary(first + k*(available/chunkCount), head);
+            if (boundary == std::string_view::npos){
+                break;
+            }
+            if (boundary > chunks.back().start){
+                chunks.emplace_back();
+                chunks.back().start = boundary;
+            }
+        }
+        for (size_t k = 0; k + 1 < chunks.size(); ++k){
+            chunks[k].limit = chunks[k + 1].start;
+        }
+        chunks.back().limit = std::string_view::npos;
+    }
+
+    if (chunks.size() < 2){
+        Cursor cursor(input, start, backend);
+        result = cursor.parser.parseNext();
+        end = offsetOf(input, cursor.parser.peek());
+        return true;
+    }
+
+    std::atomic<size_t> lastChunk(chunks.size());
+    std::vector<std::thread> workers;
+    for (size_t k = 1; k < chunks.size(); ++k){
+        workers.emplace_back(parseChunk, input, backend, std::ref(chunks[k]), k, std::ref(lastChunk));
+    }
+    parseChunk(input, backend, chunks[0], 0, lastChunk);
+    for (std::thread& worker : workers){
+        worker.join();
+    }
+
+    // Chunk 0 starts on a real element, and every following chunk only counts if the chunk
+    // before it stopped exactly where it started, until one of them reaches the ']'
+    size_t used = 0;
+    size_t total = 0;
+    for (; used < chunks.size(); ++used){
+        const Chunk& chunk = chunks[used];
+        if (chunk.failed){
+            return false;
+        }
+        total += chunk.elements.size();
+        if (chunk.reachedEnd){
+            end = chunk.end;
+            break;
+        }
+        if (used + 1 == chunks.size() || chunk.stop != chunks[used + 1].start){
+            return false;
+        }
+    }
+
+    JsonArray arr;
+    arr.reserve(total);
+    for (size_t k = 0; k <= used; ++k){
+        std::move(chunks[k].elements.begin(), chunks[k].elements.end(), std::back_inserter(arr));
+    }
+    result = JsonValue(std::move(arr));
+    chunksUsed = std::max(chunksUsed, used + 1);
+    return true;
+}
@@ -0,0 +1,58 @@
+//     __ _____ _____ _____
+//  __|  |   __|     |   | |  Simple JSON
+// |  |  |__   |  |  | | | |  version 1.0.0
+// |_____|_____|_____|_|___|
+// Copyright (c) 2025, Muhammad Ahmed
+#ifndef JSON_PARALLEL_HPP
+#define JSON_PARALLEL_HPP
+
+#include <string_view>
+#include "json_parser.hpp"
+
+//                                                  ---- Parallel Parser Class ----
+/**
+ * @brief Parses documents dominated by large arrays on several threads
+ *
+ * The root value (and the members of a root object) are parsed serially. Every large array
+ * they hold is cut into chunks: each chunk starts at a guessed element boundary (for example
+ * "},{" followed by the first key of the first element) and is parsed by its own thread, element by
+ * element, until it passes the start of the next chunk. A guess is only accepted when the
+ * previous chunk ended exactly on it, so the elements are stitched back in order and the
+ * result is identical to Parser. If the input cannot be split like that, or anything goes
+ * wrong, the whole input is parsed again with the serial Parser (which also reports errors
+ * exactly like Parser).
+ */
+class ParallelParser {
+    private:
+        bool parseSplit(JsonValue& result);
+        bool parseArray(size_t start, JsonValue& result, size_t& end);
+        size_t findBoundary(size_t from, std::string_view head) const;
+
+        std::string_view input;
+        unsigned threadCount;
+        StructuralBackend backend;
+        size_t chunksUsed;
+    public:
+        // Arrays are only split into chunks of at least this many bytes
+        static constexpr size_t MIN_CHUNK_BYTES = 1 << 20;
+
+        /**
+         * @brief Constructor for the ParallelParser
+         * @param input The JSON text (not copied, it must outlive the parser and the tokens)
+         * @param threadCount Maximum number of threads parsing at the same time (0 or 1 is serial)
+         * @param backend Structural index backend for the lexers (see Lexer)
+         */
+        ParallelParser(std::string_view input, unsigned threadCount, StructuralBackend backend = StructuralBackend::BEST);
+
+        /**
+         * @brief Parse the whole input, same result (or the same exception) as Parser::parse
+         */
+        JsonValue parse();
+
+        /**
+         * @brief Largest number of chunks an array was split into by the last parse (1 if it ran serially)
+         */
+        size_t chunkCount() const { return chunksUsed; }
+};
+
+#endif // JSON_PARALLEL_HPP
@@ -1,49 +1,164 @@
 #include "json_parser.hpp"
+#include "json_number.hpp"
+#include "json_input.hpp"
+#include <algorithm>
 #include <cctype>
+#include <cstring>
 #include <stdexcept>
 
 //                                                  ---- Lexer Implementation ----
-Lexer::Lexer(const std::string& input) : input(input), position(0) {}
+// Index the input in windows so the index stays small and hot in cache whatever the input size
+static constexpr size_t STRUCTURAL_WINDOW = 16 * 1024;
+
+Lexer::Lexer(std::string_view input, StructuralBackend backend)
+    : input(input), position(0), stream(nullptr), currentBuffer(0), windowSize(0), tokenStart(0),
+      refilledThisToken(false), streamEnded(true), useIndex(backend != StructuralBackend::NONE), indexer(backend),
+      structuralCount(0), nextStructural(0), indexedUpTo(0) {
+    if (useIndex){
+        structurals.resize(STRUCTURAL_WINDOW);
+    }
+}
+
+Lexer::Lexer(InputStream& stream, size_t windowSize)
+    : input(), position(0), stream(&stream), currentBuffer(0), windowSize(std::max<size_t>(windowSize, 64)), tokenStart(0),
+      refilledThisToken(false), streamEnded(false), useIndex(false), indexer(StructuralBackend::NONE),
+      structuralCount(0), nextStructural(0), indexedUpTo(0) {
+    refill();
+}
+
+bool Lexer::refill() {
+    if (streamEnded){
+        return false;
+    }
+    // Only the token being read is carried to the front of the buffer (skipWhitespace moves
+    // tokenStart past the whitespace it has scanned). The last token returned still points into
+    // the buffer it was read from, so the first refill of a token switches to the other buffer
+    // and leaves that one untouched.
+    size_t kept = input.length() - tokenStart;
+    if (!refilledThisToken){
+        currentBuffer = 1 - currentBuffer;
+        refilledThisToken = true;
+        if (buffers[currentBuffer].size() < std::max(windowSize, 2*kept)){
+            buffers[currentBuffer].resize(std::max(windowSize, 2*kept));
+        }
+    }
+    std::vector<char>& buffer = buffers[currentBuffer];
+    std::copy(input.begin() + tokenStart, input.end(), buffer.begin());
+    if (kept == buffer.size()){
+        // One token does not fit in the window
+        buffer.resize(2*kept);
+    }
+    size_t count = stream->read(buffer.data() + kept, buffer.size() - kept);
+    if (count == 0){
+        streamEnded = true;
+    }
+    input = std::string_view(buffer.data(), kept + count);
+    position -= tokenStart;
+    tokenStart = 0;
+    return count > 0;
+}
+
+void Lexer::indexNextWindow() {
+    size_t length = std::min(STRUCTURAL_WINDOW, input.length() - indexedUpTo);
+    nextStructural = 0;
+    structuralCount = indexer.index(input.data() + indexedUpTo, length, indexedUpTo, structurals.data());
+    indexedUpTo += length;
+}
 
 void Lexer::skipWhitespace() {
-    while (position < input.length() && std::isspace(input[position])){
-        ++position;
+    if (!useIndex){
+        while (true){
+            while (position < input.length() && std::isspace(input[position])){
+                ++position;
+            }
+            if (position < input.length()){
+                return;
+            }
+            // Nothing before the next token is needed, so a long whitespace run does not grow the buffer
+            tokenStart = position;
+            if (!refill()){
+                return;
+            }
+        }
+    }
+    if (position >= input.length() || !isJsonWhitespace(input[position])){
+        return;
+    }
+    // We are outside of a string and on whitespace, so the first non whitespace character after
+    // us is in the index: jump straight to it
+    while (true){
+        while (nextStructural < structuralCount && structurals[nextStructural] < position){
+            ++nextStructural;
+        }
+        if (nextStructural < structuralCount){
+            position = structurals[nextStructural];
+            return;
+        }
+        if (indexedUpTo >= input.length()){
+            position = input.length();
+            return;
+        }
+        indexNextWindow();
     }
 }
 
 Token Lexer::readString() {
     // Skip the opening quote
     position++;
-    size_t start = position;
-    while (position < input.length() && input[position] != '"'){
-        // In this simple impl, we dont handle escaped quotes \"
-        position++;
-    }
-    if (position >= input.length()){
-        throw std::runtime_error("Unterminated string");
+    // In this simple impl, we dont handle escaped quotes \"
+    const void* end = std::memchr(input.data() + position, '"', input.length() - position);
+    while (!end){
+        // Offsets are relative to the token, a refill can move it
+        size_t scanned = input.length() - tokenStart;
+        if (!refill()){
+            position = input.length();
+            throw std::runtime_error("Unterminated string");
+        }
+        end = std::memchr(input.data() + tokenStart + scanned, '"', input.length() - tokenStart - scanned);
     }
-    std::string result = input.substr(start, position-start);
+    size_t start = tokenStart + 1;
+    position = static_cast<const char*>(end) - input.data();
+    std::string_view result = input.substr(start, position-start);
     // Move beyond the closing quote
     position++;
     return {TokenType::STRING, result};
 }
 
+// Characters that can appear in a number token: 0-9 . - + e E
+static bool isNumberChar(char c) {
+    static constexpr struct NumberChars {
+        bool table[256] = {};
+        constexpr NumberChars() {
+            for (char c = '0'; c <= '9'; ++c){ table[static_cast<unsigned char>(c)] = true; }
+            for (char c : {'.', '-', '+', 'e', 'E'}){ table[static_cast<unsigned char>(c)] = true; }
+        }
+    } numberChars;
+    return numberChars.table[static_cast<unsigned char>(c)];
+}
+
 Token Lexer::readNumber() {
-    size_t start = position;
-    while (position < input.length() && (std::isdigit(input[position]) || input[position] == '.'
-    || input[position] == '-' || input[position] == 'e' || input[position] == 'E' || input[position] == '+' )){
-        ++position;
+    while (true){
+        while (position < input.length() && isNumberChar(input[position])){
+            ++position;
+        }
+        if (position < input.length() || !refill()){
+            break;
+        }
     }
-    std::string result = input.substr(start, position-start);
+    std::string_view result = input.substr(tokenStart, position-tokenStart);
     return {TokenType::NUMBER, result};
 }
 
 Token Lexer::readKeyword() {
-    size_t start = position;
-    while (position < input.length() && isalpha(input[position])){
-        ++position;
+    while (true){
+        while (position < input.length() && isalpha(input[position])){
+            ++position;
+        }
+        if (position < input.length() || !refill()){
+            break;
+        }
     }
-    std::string value = input.substr(start, position-start);
+    std::string_view value = input.substr(tokenStart, position-tokenStart);
     if (value == "true" || value == "false"){
         return {TokenType::BOOLEAN, value};
     }
@@ -54,27 +169,31 @@ Token Lexer::readKeyword() {
 }
 
 Token Lexer::getNextToken() {
+    // The last token returned must survive this call (see refill)
+    refilledThisToken = false;
+
     // skip the initial whitespace
     skipWhitespace();
+    tokenStart = position;
 
+    // Every token's value points into the input, so its position is value.data() - input.data()
     if (position >= input.length()){
-        return {TokenType::EOF_T, ""};
+        return {TokenType::EOF_T, input.substr(input.length())};
     }
 
     char currentChar = input[position];
 
-    if (currentChar == '{'){ position++; return {TokenType::LBRACE, "{"};}
-    if (currentChar == '}'){ position++; return {TokenType::RBRACE, "}"};}
-    if (currentChar == '['){ position++; return {TokenType::LBRACKET, "["};}
-    if (currentChar == ']'){ position++; return {TokenType::RBRACKET, "]"};}
-    if (currentChar == ','){ position++; return {TokenType::COMMA, ","};}
-    if (currentChar == ':'){ position++; return {TokenType::COLON, ":"};}
+    if (currentChar == '{'){ return {TokenType::LBRACE, input.substr(position++, 1)};}
+    if (currentChar == '}'){ return {TokenType::RBRACE, input.substr(position++, 1)};}
+    if (currentChar == '['){ return {TokenType::LBRACKET, input.substr(position++, 1)};}
+    if (currentChar == ']'){ return {TokenType::RBRACKET, input.substr(position++, 1)};}
+    if (currentChar == ','){ return {TokenType::COMMA, input.substr(position++, 1)};}
+    if (currentChar == ':'){ return {TokenType::COLON, input.substr(position++, 1)};}
 
     if (currentChar == '"'){ return readString();}
     if (std::isdigit(currentChar) || currentChar == '-'){ return readNumber();}
     if (isalpha(currentChar)){ return readKeyword();}
-    // std::string(count, char)
-    return {TokenType::UNK, std::string(1, currentChar)};
+    return {TokenType::UNK, input.substr(position, 1)};
 }
 
 //                                                  ---- Parser Implementation ----
@@ -96,6 +215,14 @@ JsonValue Parser::parse(){
     return result;
 }
 
+JsonValue Parser::parseNext(){
+    return parseValue();
+}
+
+void Parser::consume(TokenType type){
+    expect(type);
+}
+
 JsonValue Parser::parseValue(){
     switch (currentToken.type){
         case TokenType::LBRACE:
@@ -120,24 +247,26 @@ JsonValue Parser::parseObject(){
 
     if (currentToken.type == TokenType::RBRACE){
         expect(TokenType::RBRACE);
-        return JsonValue(obj);
+        return JsonValue(std::move(obj));
     }
 
     while (true) {
         if (currentToken.type != TokenType::STRING){
             throw std::runtime_error("expected string key");
         }
-        std::string key = currentToken.value;
+        JsonKey key = keys.intern(currentToken.value);
+        // The key pool is full, copy the key before the lexer moves on (the object keeps its own copy)
+        std::string unpooled = key ? std::string() : std::string(currentToken.value);
         expect(TokenType::STRING);
         expect(TokenType::COLON);
-        obj[key] = parseValue();
+        (key ? obj[key] : obj[unpooled]) = parseValue();
         if (currentToken.type == TokenType::RBRACE){
             break;
         }
         expect(TokenType::COMMA);
     }
     expect(TokenType::RBRACE);
-    return JsonValue(obj);
+    return JsonValue(std::move(obj));
 }
 
 JsonValue Parser::parseArray(){
@@ -161,16 +290,16 @@ JsonValue Parser::parseArray(){
 }
 
 JsonValue Parser::parseString(){
-    std::string result = currentToken.value;
+    std::string result = currentToken.str();
     expect(TokenType::STRING);
     return JsonValue(result);
 }
 
 JsonValue Parser::parseNumber(){
-    // NOTE: std::stod converts string to double
-    std::string result = currentToken.value;
+    // NOTE: parseJsonNumber converts the token's view in place (no std::string, no locale)
+    double result = parseJsonNumber(currentToken.value);
     expect(TokenType::NUMBER);
-    return JsonValue(std::stod(result));
+    return JsonValue(result);
 }
 
 JsonValue Parser::parseKeyword(){
@@ -7,10 +7,12 @@
 #define JSON_PARSER_HPP
 
 #include <string>
+#include <string_view>
 #include <vector>
-#include <map>
 #include <variant>
 #include <stdexcept>
+#include "json_structural.hpp"
+#include "json_object.hpp"
 
 enum class TokenType {
     LBRACE,   // {
@@ -30,18 +32,44 @@ enum class TokenType {
 /**
  * @brief A struct that represents a token in the JSON stream
  * It has a type and a value
+ * The value is a view into the lexer's input, so it is only valid as long as the input is alive
  */
 struct Token {
     TokenType type;
-    std::string value;
+    std::string_view value;
+
+    // Materialize an owned copy of the value (this is the only place a token allocates)
+    std::string str() const { return std::string(value); }
 };
 
+class InputStream;
+
 //                                                  ---- Lexer Class ----
 class Lexer {
     private:
-        const std::string& input;
+        std::string_view input;
         size_t position;
-        
+
+        // Streaming: input is a window over one of two buffers refilled from the stream. The first
+        // refill while reading a token switches buffers, so the last token returned stays where it is.
+        InputStream* stream;
+        std::vector<char> buffers[2];
+        int currentBuffer;
+        size_t windowSize;
+        size_t tokenStart;     // start of the token being read
+        bool refilledThisToken;
+        bool streamEnded;
+
+        // Token start positions for the window of input indexed so far (see StructuralIndexer)
+        bool useIndex;
+        StructuralIndexer indexer;
+        std::vector<size_t> structurals;
+        size_t structuralCount;
+        size_t nextStructural;
+        size_t indexedUpTo;
+
+        void indexNextWindow();
+        bool refill();
         void skipWhitespace();
         Token readString();
         Token readNumber();
@@ -49,9 +77,21 @@ class Lexer {
     public:
         /**
         * @brief Constructor for the Lexer
-        * @param input The input string to be parsed
+        * @param input The input string to be parsed (not copied, it must outlive the lexer)
+        * @param backend How to build the structural index used to jump over whitespace (NONE to walk byte by byte)
         */
-        Lexer(const std::string& input);
+        Lexer(std::string_view input, StructuralBackend backend = StructuralBackend::BEST);
+
+        /**
+        * @brief Constructor for a Lexer that pulls its input from a stream, windowSize bytes at a time
+        * Memory stays at two windows (more only for a single token longer than a window) whatever the
+        * size of the input. A token's value stays valid until the second getNextToken() call after it,
+        * which is enough for Parser, EventReader and SchemaReader.
+        * The structural index is not used in this mode.
+        */
+        Lexer(InputStream& stream, size_t windowSize = DEFAULT_WINDOW);
+
+        static constexpr size_t DEFAULT_WINDOW = 4 * 1024 * 1024;
 
         /**
         * @brief Get the next token from the input stream
@@ -62,8 +102,7 @@ class Lexer {
 //                                                  ---- JSON Value Class ----
 class JsonValue;
 
-// Custom Value Types
-using JsonObject = std::map<std::string, JsonValue>;
+// Custom Value Types (JsonObject is in json_object.hpp)
 using JsonArray  = std::vector<JsonValue>;
 using Value = std::variant<std::nullptr_t, bool, double, std::string, JsonObject, JsonArray>;
 
@@ -112,6 +151,7 @@ class Parser {
 
         Lexer& lexer;
         Token currentToken;
+        JsonKeyCache keys;
     
     public:
         /**
@@ -125,6 +165,23 @@ class Parser {
          * @return A JsonValue object representing the parsed JSON
          */
         JsonValue parse();
+
+        // Lower level interface for callers that drive the grammar themselves (see ParallelParser)
+
+        /**
+         * @brief Parse the next value, without requiring the input to end after it
+         */
+        JsonValue parseNext();
+
+        /**
+         * @brief The token right after the last parsed value (not consumed yet)
+         */
+        const Token& peek() const { return currentToken; }
+
+        /**
+         * @brief Consume the current token, throws if it is not of the given type
+         */
+        void consume(TokenType type);
 };
 
 #endif // JSON_PARSER_HPP
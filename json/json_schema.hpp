@@ -0,0 +1,329 @@
+//     __ _____ _____ _____
+//  __|  |   __|     |   | |  Simple JSON
+// |  |  |__   |  |  | | | |  version 1.0.0
+// |_____|_____|_____|_|___|
+// Copyright (c) 2025, Muhammad Ahmed
+#ifndef JSON_SCHEMA_HPP
+#define JSON_SCHEMA_HPP
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <stdexcept>
+#include "json_parser.hpp"
+#include "json_number.hpp"
+
+/**
+ * Schema bound parsing: declare a struct and its JSON field names once, and SchemaReader fills it
+ * straight from the token stream, with no intermediate document.
+ *
+ *     struct Pair { double x0, y0, x1, y1; };
+ *     template <> struct JsonSchema<Pair> {
+ *         static constexpr auto fields = std::make_tuple(
+ *             jsonField("x0", &Pair::x0), jsonField("y0", &Pair::y0),
+ *             jsonField("x1", &Pair::x1), jsonField("y1", &Pair::y1));
+ *     };
+ *
+ * Supported member types: double, bool, std::string, std::vector<U>, JsonColumns<U> and any
+ * struct U with its own JsonSchema. Keys that are not in the schema are skipped without
+ * converting anything, missing keys leave the member untouched, and like Parser the last
+ * duplicate key wins.
+ */
+template <typename T>
+struct JsonSchema;
+
+template <typename T, typename M>
+struct JsonField {
+    std::string_view name;
+    M T::* member;
+};
+
+template <typename T, typename M>
+constexpr JsonField<T, M> jsonField(std::string_view name, M T::* member) {
+    return {name, member};
+}
+
+//                                                  ---- Compile time key lookup ----
+/**
+ * @brief Maps a key to the index of the field in JsonSchema<T>::fields (or -1)
+ *
+ * Objects are usually written in declaration order, so the field after the last matched one is
+ * tried first with a single compare. Otherwise a perfect hash, whose seed is searched for at
+ * compile time, gives the only candidate.
+ */
+template <typename T>
+struct JsonFieldIndex {
+    static constexpr size_t COUNT = std::tuple_size_v<std::decay_t<decltype(JsonSchema<T>::fields)>>;
+
+    static constexpr std::array<std::string_view, COUNT> NAMES = std::apply(
+        [](auto... field) { return std::array<std::string_view, COUNT>{field.name...}; }, JsonSchema<T>::fields);
+
+    static constexpr size_t TABLE_SIZE = [] {
+        size_t size = 4;
+        while (size < 2*COUNT){
+            size *= 2;
+        }
+        return size;
+    }();
+
+    static constexpr uint32_t hash(std::string_view key, uint32_t seed) {
+        uint32_t h = 2166136261u ^ seed;
+        for (char c : key){
+            h = (h ^ static_cast<uint8_t>(c)) * 16777619u;
+        }
+        h ^= h >> 15;
+        return h;
+    }
+
+    static constexpr bool collisionFree(uint32_t seed) {
+        std::array<bool, TABLE_SIZE> used{};
+        for (std::string_view name : NAMES){
+            size_t slot = hash(name, seed) & (TABLE_SIZE - 1);
+            if (used[slot]){
+                return false;
+            }
+            used[slot] = true;
+        }
+        return true;
+    }
+
+    static constexpr uint32_t SEED = [] {
+        uint32_t seed = 0;
+        while (!collisionFree(seed)){
+            ++seed;
+        }
+        return seed;
+    }();
+
+    static constexpr std::array<int, TABLE_SIZE> SLOTS = [] {
+        std::array<int, TABLE_SIZE> slots{};
+        for (int& slot : slots){
+            slot = -1;
+        }
+        for (size_t index = 0; index < COUNT; ++index){
+            slots[hash(NAMES[index], SEED) & (TABLE_SIZE - 1)] = static_cast<int>(index);
+        }
+        return slots;
+    }();
+
+    static int find(std::string_view key, size_t expected) {
+        if (expected < COUNT && NAMES[expected] == key){
+            return static_cast<int>(expected);
+        }
+        int index = SLOTS[hash(key, SEED) & (TABLE_SIZE - 1)];
+        return (index >= 0 && NAMES[index] == key) ? index : -1;
+    }
+};
+
+//                                                  ---- Structure of Arrays ----
+/**
+ * @brief An array of T stored column by column: one contiguous std::vector<double> per field
+ * All fields of T must be doubles.
+ */
+template <typename T>
+class JsonColumns {
+    public:
+        using value_type = T;
+        static constexpr size_t FIELD_COUNT = JsonFieldIndex<T>::COUNT;
+
+        size_t size() const { return columns[0].size(); }
+        bool empty() const { return columns[0].empty(); }
+
+        const std::vector<double>& column(size_t index) const { return columns[index]; }
+        const std::vector<double>& column(std::string_view name) const {
+            for (size_t index = 0; index < FIELD_COUNT; ++index){
+                if (JsonFieldIndex<T>::NAMES[index] == name){
+                    return columns[index];
+                }
+            }
+            throw std::out_of_range("no such column");
+        }
+
+        void push_back(const T& value) {
+            pushFields(value, std::make_index_sequence<FIELD_COUNT>{});
+        }
+
+    private:
+        template <size_t... I>
+        void pushFields(const T& value, std::index_sequence<I...>) {
+            static_assert((std::is_same_v<std::decay_t<decltype(value.*(std::get<I>(JsonSchema<T>::fields).member))>, double> && ...),
+                          "JsonColumns only supports structs made of doubles");
+            (columns[I].push_back(value.*(std::get<I>(JsonSchema<T>::fields).member)), ...);
+        }
+
+        std::array<std::vector<double>, FIELD_COUNT> columns;
+};
+
+//                                                  ---- Schema Reader Class ----
+template <typename T> struct IsVector : std::false_type {};
+template <typename U> struct IsVector<std::vector<U>> : std::true_type {};
+template <typename T> struct IsColumns : std::false_type {};
+template <typename U> struct IsColumns<JsonColumns<U>> : std::true_type {};
+
+/**
+ * @brief Reads JSON from a Lexer directly into C++ objects described by JsonSchema
+ */
+class SchemaReader {
+    private:
+        Lexer& lexer;
+        Token currentToken;
+
+        void expect(TokenType type) {
+            if (currentToken.type == type){
+                currentToken = lexer.getNextToken();
+            } else {
+                throw std::runtime_error("Unexpected token: expected one type, got another");
+            }
+        }
+
+        template <typename T, size_t... I>
+        void readField(T& out, int index, std::index_sequence<I...>) {
+            ((index == static_cast<int>(I) ? (read(out.*(std::get<I>(JsonSchema<T>::fields).member)), true) : false) || ...);
+        }
+
+        template <typename T>
+        void readObject(T& out) {
+            using Index = JsonFieldIndex<T>;
+            expect(TokenType::LBRACE);
+            if (currentToken.type == TokenType::RBRACE){
+                expect(TokenType::RBRACE);
+                return;
+            }
+            size_t expected = 0;
+            while (true){
+                if (currentToken.type != TokenType::STRING){
+                    throw std::runtime_error("expected string key");
+                }
+                int index = Index::find(currentToken.value, expected);
+                expect(TokenType::STRING);
+                expect(TokenType::COLON);
+                if (index >= 0){
+                    readField(out, index, std::make_index_sequence<Index::COUNT>{});
+                    expected = static_cast<size_t>(index) + 1;
+                } else {
+                    skipValue();
+                }
+                if (currentToken.type == TokenType::RBRACE){
+                    break;
+                }
+                expect(TokenType::COMMA);
+            }
+            expect(TokenType::RBRACE);
+        }
+
+        template <typename Container>
+        void readArray(Container& out) {
+            expect(TokenType::LBRACKET);
+            if (currentToken.type == TokenType::RBRACKET){
+                expect(TokenType::RBRACKET);
+                return;
+            }
+            while (true){
+                if constexpr (IsColumns<Container>::value){
+                    typename Container::value_type element{};
+                    read(element);
+                    out.push_back(element);
+                } else {
+                    out.emplace_back();
+                    read(out.back());
+                }
+                if (currentToken.type == TokenType::RBRACKET){
+                    break;
+                }
+                expect(TokenType::COMMA);
+            }
+            expect(TokenType::RBRACKET);
+        }
+
+    public:
+        /**
+         * @brief Constructor for the SchemaReader
+         * @param lexer The lexer to use for tokenization
+         */
+        SchemaReader(Lexer& lexer) : lexer(lexer), currentToken(lexer.getNextToken()) {}
+
+        /**
+         * @brief Read the next JSON value into out, throws std::runtime_error if it does not fit
+         */
+        template <typename T>
+        void read(T& out) {
+            if constexpr (std::is_same_v<T, double>){
+                if (currentToken.type != TokenType::NUMBER){
+                    throw std::runtime_error("expected a number");
+                }
+                out = parseJsonNumber(currentToken.value);
+                expect(TokenType::NUMBER);
+            } else if constexpr (std::is_same_v<T, bool>){
+                if (currentToken.type != TokenType::BOOLEAN){
+                    throw std::runtime_error("expected a boolean");
+                }
+                out = (currentToken.value == "true");
+                expect(TokenType::BOOLEAN);
+            } else if constexpr (std::is_same_v<T, std::string>){
+                if (currentToken.type != TokenType::STRING){
+                    throw std::runtime_error("expected a string");
+                }
+                out = currentToken.str();
+                expect(TokenType::STRING);
+            } else if constexpr (IsVector<T>::value || IsColumns<T>::value){
+                readArray(out);
+            } else {
+                readObject(out);
+            }
+        }
+
+        /**
+         * @brief Read the whole input as one T
+         */
+        template <typename T>
+        T parse() {
+            T result{};
+            read(result);
+            if (currentToken.type != TokenType::EOF_T){
+                throw std::runtime_error("unexpected characters at the end of file");
+            }
+            return result;
+        }
+
+        /**
+         * @brief Skip over the next value (including whole objects and arrays) without converting it
+         * Inside the skipped value only the bracket nesting is checked.
+         */
+        void skipValue() {
+            size_t depth = 0;
+            do {
+                switch (currentToken.type){
+                    case TokenType::LBRACE:
+                    case TokenType::LBRACKET:
+                        ++depth;
+                        break;
+                    case TokenType::RBRACE:
+                    case TokenType::RBRACKET:
+                        if (depth == 0){
+                            throw std::runtime_error("unexpected token when parsing value");
+                        }
+                        --depth;
+                        break;
+                    case TokenType::EOF_T:
+                    case TokenType::UNK:
+                        throw std::runtime_error("unexpected token when parsing value");
+                    case TokenType::COMMA:
+                    case TokenType::COLON:
+                        if (depth == 0){
+                            throw std::runtime_error("unexpected token when parsing value");
+                        }
+                        break;
+                    default:
+                        break;
+                }
+                currentToken = lexer.getNextToken();
+            } while (depth > 0);
+        }
+};
+
+#endif // JSON_SCHEMA_HPP
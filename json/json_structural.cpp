@@ -0,0 +1,147 @@
+#include "json_structural.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JSON_STRUCTURAL_X86 1
+#else
+#define JSON_STRUCTURAL_X86 0
+#endif
+
+//                                                  ---- Block Classifiers ----
+// Each classifier sets bit i of the masks if byte i of the 64 byte block is a quote,
+// one of {}[]:, or whitespace. They do not know anything about strings.
+
+static void classifyScalar(const char* block, uint64_t& quotes, uint64_t& structurals, uint64_t& whitespace) {
+    quotes = 0;
+    structurals = 0;
+    whitespace = 0;
+    for (int i = 0; i < 64; ++i){
+        char c = block[i];
+        uint64_t bit = 1ULL << i;
+        if (c == '"'){
+            quotes |= bit;
+        } else if (c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ','){
+            structurals |= bit;
+        } else if (isJsonWhitespace(c)){
+            whitespace |= bit;
+        }
+    }
+}
+
+#if JSON_STRUCTURAL_X86
+static void classifySSE2(const char* block, uint64_t& quotes, uint64_t& structurals, uint64_t& whitespace) {
+    quotes = 0;
+    structurals = 0;
+    whitespace = 0;
+    for (int i = 0; i < 4; ++i){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16*i));
+        // '[' | 0x20 == '{' and ']' | 0x20 == '}', so two compares cover all four brackets
+        __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        __m128i s = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(lower, _mm_set1_epi8('{')), _mm_cmpeq_epi8(lower, _mm_set1_epi8('}'))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')), _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+        // Signed compares, so bytes >= 0x80 are never in the '\t'..'\r' range
+        __m128i w = _mm_or_si128(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+            _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1))));
+        __m128i q = _mm_cmpeq_epi8(v, _mm_set1_epi8('"'));
+
+        quotes |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(q))) << (16*i);
+        structurals |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(s))) << (16*i);
+        whitespace |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(w))) << (16*i);
+    }
+}
+
+__attribute__((target("avx2")))
+static void classifyAVX2(const char* block, uint64_t& quotes, uint64_t& structurals, uint64_t& whitespace) {
+    quotes = 0;
+    structurals = 0;
+    whitespace = 0;
+    for (int i = 0; i < 2; ++i){
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32*i));
+        __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        __m256i s = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(lower, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('}'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))));
+        __m256i w = _mm256_or_si256(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+            _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('\t' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), v)));
+        __m256i q = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'));
+
+        quotes |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(q))) << (32*i);
+        structurals |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(s))) << (32*i);
+        whitespace |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(w))) << (32*i);
+    }
+}
+#endif
+
+//                                                  ---- Structural Indexer Implementation ----
+StructuralIndexer::StructuralIndexer(StructuralBackend backend) : inString(0), prevWhitespace(0) {
+#if JSON_STRUCTURAL_X86
+    if (backend == StructuralBackend::BEST || backend == StructuralBackend::AVX2){
+        backend = __builtin_cpu_supports("avx2") ? StructuralBackend::AVX2 : StructuralBackend::SSE2;
+    }
+#else
+    backend = StructuralBackend::SCALAR;
+#endif
+    backend_ = backend;
+    switch (backend){
+#if JSON_STRUCTURAL_X86
+        case StructuralBackend::AVX2: classify = classifyAVX2; break;
+        case StructuralBackend::SSE2: classify = classifySSE2; break;
+#endif
+        default: classify = classifyScalar; break;
+    }
+}
+
+// Bit i of the result is the xor of bits 0..i of x
+static uint64_t prefixXor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+size_t StructuralIndexer::indexBlock(const char* block, size_t base, size_t* out) {
+    uint64_t quotes, structurals, whitespace;
+    classify(block, quotes, structurals, whitespace);
+
+    // Set from an opening quote up to (but not including) its closing quote
+    uint64_t inside = prefixXor(quotes) ^ inString;
+    inString = static_cast<uint64_t>(static_cast<int64_t>(inside) >> 63);
+    uint64_t outside = ~inside;
+
+    structurals &= outside;
+    whitespace &= outside;
+    uint64_t followsWhitespace = (whitespace << 1) | prevWhitespace;
+    prevWhitespace = whitespace >> 63;
+
+    uint64_t scalarStarts = ~(structurals | whitespace | quotes) & outside & followsWhitespace;
+    uint64_t starts = structurals | scalarStarts | (quotes & inside);
+    size_t count = 0;
+    while (starts){
+        out[count++] = base + __builtin_ctzll(starts);
+        starts &= starts - 1;
+    }
+    return count;
+}
+
+size_t StructuralIndexer::index(const char* data, size_t length, size_t base, size_t* out) {
+    size_t count = 0;
+    size_t offset = 0;
+    for (; offset + 64 <= length; offset += 64){
+        count += indexBlock(data + offset, base + offset, out + count);
+    }
+    if (offset < length){
+        // Pad the tail with whitespace, it can never produce a position
+        char tail[64];
+        std::memset(tail, ' ', sizeof(tail));
+        std::memcpy(tail, data + offset, length - offset);
+        count += indexBlock(tail, base + offset, out + count);
+    }
+    return count;
+}
@@ -0,0 +1,70 @@
+//     __ _____ _____ _____
+//  __|  |   __|     |   | |  Simple JSON
+// |  |  |__   |  |  | | | |  version 1.0.0
+// |_____|_____|_____|_|___|
+// Copyright (c) 2025, Muhammad Ahmed
+#ifndef JSON_STRUCTURAL_HPP
+#define JSON_STRUCTURAL_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Which implementation classifies the input bytes.
+ * BEST picks the widest one the CPU supports at runtime.
+ * NONE tells the Lexer not to build an index at all and walk the input byte by byte.
+ */
+enum class StructuralBackend {
+    NONE,
+    SCALAR,
+    SSE2,
+    AVX2,
+    BEST
+};
+
+/**
+ * @brief First pass over the input that finds every position a token can start at
+ *
+ * The input is classified 64 bytes at a time into quote, structural ({}[]:,) and whitespace
+ * bitmaps. From those we record:
+ *   - structural characters outside of strings
+ *   - opening quotes
+ *   - any other non whitespace character outside of strings that follows whitespace
+ * Like the Lexer, a quote always toggles the string state (escaped quotes are not supported).
+ *
+ * Blocks must be fed in order since the string and whitespace state is carried between them.
+ */
+class StructuralIndexer {
+    private:
+        using ClassifyFn = void (*)(const char* block, uint64_t& quotes, uint64_t& structurals, uint64_t& whitespace);
+
+        ClassifyFn classify;
+        StructuralBackend backend_;
+        uint64_t inString;       // all ones if the previous block ended inside a string
+        uint64_t prevWhitespace; // 1 if the previous block ended with (outside of string) whitespace
+
+        size_t indexBlock(const char* block, size_t base, size_t* out);
+    public:
+        explicit StructuralIndexer(StructuralBackend backend = StructuralBackend::BEST);
+
+        /**
+         * @brief Index the next length bytes of the input
+         * @param data Start of the bytes to index
+         * @param length Number of bytes, must be a multiple of 64 unless this is the last call
+         * @param base Offset of data in the whole input, added to every recorded position
+         * @param out Positions are written to it in increasing order, it must have room for length entries
+         * @return The number of positions written
+         */
+        size_t index(const char* data, size_t length, size_t base, size_t* out);
+
+        StructuralBackend backend() const { return backend_; }
+};
+
+/**
+ * @brief Same whitespace definition as std::isspace in the "C" locale
+ */
+inline bool isJsonWhitespace(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+#endif // JSON_STRUCTURAL_HPP
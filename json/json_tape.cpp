@@ -0,0 +1,279 @@
+#include "json_tape.hpp"
+#include "json_number.hpp"
+#include "../profiler/Profiler.h"
+#include <cstring>
+#include <new>
+#include <utility>
+#include <sys/mman.h>
+
+//                                                  ---- Arena Implementation ----
+Arena::Arena(size_t capacity) : base(nullptr), capacity(capacity), used(0) {
+    if (capacity == 0){
+        return;
+    }
+    // NORESERVE: we only pay (in RSS and commit charge) for the pages we actually write to
+    void* memory = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory == MAP_FAILED){
+        throw std::bad_alloc();
+    }
+    base = static_cast<char*>(memory);
+}
+
+Arena::~Arena() {
+    if (base){
+        munmap(base, capacity);
+    }
+}
+
+Arena::Arena(Arena&& other) noexcept : base(other.base), capacity(other.capacity), used(other.used) {
+    other.base = nullptr;
+    other.capacity = 0;
+    other.used = 0;
+}
+
+Arena& Arena::operator=(Arena&& other) noexcept {
+    if (this != &other){
+        std::swap(base, other.base);
+        std::swap(capacity, other.capacity);
+        std::swap(used, other.used);
+    }
+    return *this;
+}
+
+//                                                  ---- Tape Document Implementation ----
+// Every value takes at least one byte of input and every string needs two quotes, so these
+// bounds can never be exceeded. Only the part we fill is ever backed by physical memory.
+static size_t maxTapeEntries(size_t inputSize) { return inputSize + 2; }
+static size_t maxNumbers(size_t inputSize) { return inputSize + 1; }
+static size_t maxStringBytes(size_t inputSize) { return 2*inputSize + 8; }
+
+TapeDocument::TapeDocument(size_t inputSize)
+    : arena(maxTapeEntries(inputSize)*sizeof(uint64_t) + maxNumbers(inputSize)*sizeof(double) + maxStringBytes(inputSize) + 64),
+      tapeSize(0), numberCount(0), stringBytes(0) {
+    tape = arena.allocate<uint64_t>(maxTapeEntries(inputSize));
+    numbers = arena.allocate<double>(maxNumbers(inputSize));
+    strings = arena.allocate<char>(maxStringBytes(inputSize));
+}
+
+TapeType TapeValue::type() const {
+    return static_cast<TapeType>(doc->entry(index) >> 56);
+}
+
+size_t TapeValue::next() const {
+    TapeType t = type();
+    if (t == TapeType::OBJECT_START || t == TapeType::ARRAY_START){
+        return (doc->entry(index) & TapeDocument::PAYLOAD_MASK) + 1;
+    }
+    return index + 1;
+}
+
+TapeObject TapeValue::asObject() const {
+    if (!isObject()){
+        throw std::runtime_error("tape value is not an object");
+    }
+    return TapeObject(doc, index);
+}
+
+TapeArray TapeValue::asArray() const {
+    if (!isArray()){
+        throw std::runtime_error("tape value is not an array");
+    }
+    return TapeArray(doc, index);
+}
+
+std::string_view TapeValue::asString() const {
+    if (!isString()){
+        throw std::runtime_error("tape value is not a string");
+    }
+    const char* at = doc->strings + (doc->entry(index) & TapeDocument::PAYLOAD_MASK);
+    uint32_t length;
+    std::memcpy(&length, at, sizeof(length));
+    return std::string_view(at + sizeof(length), length);
+}
+
+double TapeValue::asNumber() const {
+    if (!isNumber()){
+        throw std::runtime_error("tape value is not a number");
+    }
+    return doc->numbers[doc->entry(index) & TapeDocument::PAYLOAD_MASK];
+}
+
+bool TapeValue::asBool() const {
+    if (!isBool()){
+        throw std::runtime_error("tape value is not a bool");
+    }
+    return type() == TapeType::TRUE_T;
+}
+
+TapeArray::TapeArray(const TapeDocument* doc, size_t start)
+    : doc(doc), begin_(start), end_(doc->entry(start) & TapeDocument::PAYLOAD_MASK) {}
+
+size_t TapeArray::size() const {
+    return doc->entry(end_) & TapeDocument::PAYLOAD_MASK;
+}
+
+TapeObject::TapeObject(const TapeDocument* doc, size_t start)
+    : doc(doc), begin_(start), end_(doc->entry(start) & TapeDocument::PAYLOAD_MASK) {}
+
+TapeObject::Member TapeObject::iterator::operator*() const {
+    return {TapeValue(doc, index).asString(), TapeValue(doc, index + 1)};
+}
+
+size_t TapeObject::size() const {
+    return doc->entry(end_) & TapeDocument::PAYLOAD_MASK;
+}
+
+size_t TapeObject::count(std::string_view key) const {
+    size_t result = 0;
+    for (Member member : *this){
+        if (member.key == key){
+            ++result;
+        }
+    }
+    return result;
+}
+
+TapeValue TapeObject::at(std::string_view key) const {
+    // Like std::map::operator[] in Parser, the last duplicate key wins
+    size_t found = 0;
+    for (auto it = begin(); it != end(); ++it){
+        Member member = *it;
+        if (member.key == key){
+            found = member.value.tapeIndex();
+        }
+    }
+    if (found == 0){
+        throw std::out_of_range("key not found in object");
+    }
+    return TapeValue(doc, found);
+}
+
+//                                                  ---- Tape Parser Implementation ----
+TapeParser::TapeParser(Lexer& lexer, size_t inputSize)
+    : lexer(lexer), currentToken(lexer.getNextToken()), doc(nullptr), inputSize(inputSize) {}
+
+void TapeParser::expect(TokenType type) {
+    if (currentToken.type == type){
+        currentToken = lexer.getNextToken();
+    } else {
+        throw std::runtime_error("Unexpected token: expected one type, got another");
+    }
+}
+
+void TapeParser::append(TapeType type, uint64_t payload) {
+    doc->tape[doc->tapeSize++] = (static_cast<uint64_t>(type) << 56) | payload;
+}
+
+uint64_t TapeParser::appendString(std::string_view value) {
+    uint64_t offset = doc->stringBytes;
+    uint32_t length = static_cast<uint32_t>(value.size());
+    std::memcpy(doc->strings + offset, &length, sizeof(length));
+    std::memcpy(doc->strings + offset + sizeof(length), value.data(), value.size());
+    doc->stringBytes += sizeof(length) + value.size();
+    return offset;
+}
+
+TapeDocument TapeParser::parse(){
+    PROFILE_BANDWIDTH("Parse JSON", inputSize);
+    TapeDocument result(inputSize);
+    doc = &result;
+    parseValue();
+    doc = nullptr;
+    if (currentToken.type != TokenType::EOF_T){
+        throw std::runtime_error("unexpected characters at the end of file");
+    }
+    return result;
+}
+
+void TapeParser::parseValue(){
+    switch (currentToken.type){
+        case TokenType::LBRACE:
+            return parseObject();
+        case TokenType::LBRACKET:
+            return parseArray();
+        case TokenType::STRING:
+            return parseString();
+        case TokenType::NUMBER:
+            return parseNumber();
+        case TokenType::BOOLEAN:
+        case TokenType::NULL_T:
+            return parseKeyword();
+        default:
+            throw std::runtime_error("unexpected token when parsing value");
+    }
+}
+
+void TapeParser::parseObject(){
+    expect(TokenType::LBRACE);
+    // Reserve the start entry, it gets patched with the index of the end entry once we know it
+    size_t start = doc->tapeSize;
+    append(TapeType::OBJECT_START, 0);
+    uint64_t count = 0;
+
+    if (currentToken.type != TokenType::RBRACE){
+        while (true) {
+            if (currentToken.type != TokenType::STRING){
+                throw std::runtime_error("expected string key");
+            }
+            parseString();
+            expect(TokenType::COLON);
+            parseValue();
+            ++count;
+            if (currentToken.type == TokenType::RBRACE){
+                break;
+            }
+            expect(TokenType::COMMA);
+        }
+    }
+    expect(TokenType::RBRACE);
+    doc->tape[start] |= doc->tapeSize;
+    append(TapeType::OBJECT_END, count);
+}
+
+void TapeParser::parseArray(){
+    expect(TokenType::LBRACKET);
+    size_t start = doc->tapeSize;
+    append(TapeType::ARRAY_START, 0);
+    uint64_t count = 0;
+
+    if (currentToken.type != TokenType::RBRACKET){
+        while (true){
+            parseValue();
+            ++count;
+            if (currentToken.type == TokenType::RBRACKET){
+                break;
+            }
+            expect(TokenType::COMMA);
+        }
+    }
+    expect(TokenType::RBRACKET);
+    doc->tape[start] |= doc->tapeSize;
+    append(TapeType::ARRAY_END, count);
+}
+
+void TapeParser::parseString(){
+    append(TapeType::STRING, appendString(currentToken.value));
+    expect(TokenType::STRING);
+}
+
+void TapeParser::parseNumber(){
+    // NOTE: same conversion as Parser::parseNumber so both documents hold identical doubles
+    double value = parseJsonNumber(currentToken.value);
+    expect(TokenType::NUMBER);
+    doc->numbers[doc->numberCount] = value;
+    append(TapeType::NUMBER, doc->numberCount++);
+}
+
+void TapeParser::parseKeyword(){
+    if (currentToken.type == TokenType::BOOLEAN){
+        append(currentToken.value == "true" ? TapeType::TRUE_T : TapeType::FALSE_T, 0);
+        expect(TokenType::BOOLEAN);
+        return;
+    }
+    if (currentToken.type == TokenType::NULL_T){
+        append(TapeType::NULL_T, 0);
+        expect(TokenType::NULL_T);
+        return;
+    }
+    throw std::runtime_error("unexpected token when parsing keyword");
+}
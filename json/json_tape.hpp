@@ -0,0 +1,244 @@
+//     __ _____ _____ _____
+//  __|  |   __|     |   | |  Simple JSON
+// |  |  |__   |  |  | | | |  version 1.0.0
+// |_____|_____|_____|_|___|
+// Copyright (c) 2025, Muhammad Ahmed
+#ifndef JSON_TAPE_HPP
+#define JSON_TAPE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <stdexcept>
+#include "json_parser.hpp"
+
+//                                                  ---- Arena Class ----
+/**
+ * @brief A bump allocator over one reserved block of virtual memory
+ * Nothing is freed individually, the whole block is released at once when the arena dies.
+ * Pages are only backed by physical memory once they are touched, so reserving a generous
+ * upper bound up front is cheap.
+ */
+class Arena {
+    private:
+        char* base;
+        size_t capacity;
+        size_t used;
+    public:
+        /**
+         * @brief Reserve (but do not commit) capacity bytes of address space
+         */
+        explicit Arena(size_t capacity);
+        ~Arena();
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+        Arena(Arena&& other) noexcept;
+        Arena& operator=(Arena&& other) noexcept;
+
+        /**
+         * @brief Bump allocate count objects of type T, throws std::bad_alloc if the arena is full
+         */
+        template <typename T>
+        T* allocate(size_t count) {
+            size_t aligned = (used + alignof(T) - 1) & ~(alignof(T) - 1);
+            if (count > (capacity - aligned) / sizeof(T)){
+                throw std::bad_alloc();
+            }
+            used = aligned + count * sizeof(T);
+            return reinterpret_cast<T*>(base + aligned);
+        }
+};
+
+//                                                  ---- Tape Document ----
+/**
+ * The tape is a flat array of 64 bit entries, one per value (and one per closing bracket).
+ * The top 8 bits hold the type tag and the low 56 bits hold the payload:
+ *   '{' / '[' : index of the matching '}' / ']' entry
+ *   '}' / ']' : number of members / elements of the container
+ *   '"'       : offset of the string in the string buffer (u32 length followed by the bytes)
+ *   'd'       : index of the number in the number buffer
+ *   't' / 'f' / 'n' : unused
+ * Objects are stored as alternating key (string) and value entries.
+ */
+enum class TapeType : uint8_t {
+    OBJECT_START = '{',
+    OBJECT_END   = '}',
+    ARRAY_START  = '[',
+    ARRAY_END    = ']',
+    STRING       = '"',
+    NUMBER       = 'd',
+    TRUE_T       = 't',
+    FALSE_T      = 'f',
+    NULL_T       = 'n'
+};
+
+class TapeDocument;
+class TapeObject;
+class TapeArray;
+
+/**
+ * @brief A read only handle to a value on the tape
+ * It is two words big and is meant to be passed around by value.
+ * Like JsonValue, the asX() methods throw if the type is not the expected one
+ */
+class TapeValue {
+    private:
+        const TapeDocument* doc;
+        size_t index;
+    public:
+        TapeValue(const TapeDocument* doc, size_t index): doc(doc), index(index) {}
+
+        TapeType type() const;
+
+        // Convenience methods to check type
+        bool isObject() const { return type() == TapeType::OBJECT_START;}
+        bool isArray() const { return type() == TapeType::ARRAY_START;}
+        bool isString() const { return type() == TapeType::STRING;}
+        bool isNumber() const { return type() == TapeType::NUMBER;}
+        bool isBool() const { return type() == TapeType::TRUE_T || type() == TapeType::FALSE_T;}
+        bool isNull() const { return type() == TapeType::NULL_T;}
+
+        // Convenience methods to get the value
+        TapeObject asObject() const;
+        TapeArray asArray() const;
+        std::string_view asString() const;
+        double asNumber() const;
+        bool asBool() const;
+
+        /**
+         * @brief Index of the entry right after this value (skips over whole containers)
+         */
+        size_t next() const;
+        size_t tapeIndex() const { return index; }
+};
+
+/**
+ * @brief Iterates over the elements of an array or over the key/value pairs of an object
+ */
+class TapeArray {
+    private:
+        const TapeDocument* doc;
+        size_t begin_;
+        size_t end_;
+    public:
+        class iterator {
+            private:
+                const TapeDocument* doc;
+                size_t index;
+            public:
+                iterator(const TapeDocument* doc, size_t index): doc(doc), index(index) {}
+                TapeValue operator*() const { return TapeValue(doc, index); }
+                iterator& operator++() { index = TapeValue(doc, index).next(); return *this; }
+                bool operator!=(const iterator& other) const { return index != other.index; }
+        };
+
+        TapeArray(const TapeDocument* doc, size_t start);
+
+        iterator begin() const { return iterator(doc, begin_ + 1); }
+        iterator end() const { return iterator(doc, end_); }
+        size_t size() const;
+        bool empty() const { return begin_ + 1 == end_; }
+};
+
+class TapeObject {
+    private:
+        const TapeDocument* doc;
+        size_t begin_;
+        size_t end_;
+    public:
+        struct Member {
+            std::string_view key;
+            TapeValue value;
+        };
+
+        class iterator {
+            private:
+                const TapeDocument* doc;
+                size_t index;
+            public:
+                iterator(const TapeDocument* doc, size_t index): doc(doc), index(index) {}
+                Member operator*() const;
+                iterator& operator++() { index = TapeValue(doc, index + 1).next(); return *this; }
+                bool operator!=(const iterator& other) const { return index != other.index; }
+        };
+
+        TapeObject(const TapeDocument* doc, size_t start);
+
+        iterator begin() const { return iterator(doc, begin_ + 1); }
+        iterator end() const { return iterator(doc, end_); }
+        size_t size() const;
+        bool empty() const { return begin_ + 1 == end_; }
+
+        // Linear scan over the keys, objects are expected to be small
+        size_t count(std::string_view key) const;
+        TapeValue at(std::string_view key) const;
+};
+
+/**
+ * @brief A parsed JSON document stored as a tape plus string and number side buffers
+ * All three live in a single arena owned by the document and are freed together.
+ */
+class TapeDocument {
+    private:
+        friend class TapeParser;
+        friend class TapeValue;
+
+        Arena arena;
+        uint64_t* tape;
+        size_t tapeSize;
+        double* numbers;
+        size_t numberCount;
+        char* strings;
+        size_t stringBytes;
+
+        explicit TapeDocument(size_t inputSize);
+    public:
+        static constexpr uint64_t PAYLOAD_MASK = (1ULL << 56) - 1;
+
+        TapeDocument(TapeDocument&&) noexcept = default;
+        TapeDocument& operator=(TapeDocument&&) noexcept = default;
+
+        TapeValue root() const { return TapeValue(this, 0); }
+
+        uint64_t entry(size_t index) const { return tape[index]; }
+        size_t size() const { return tapeSize; }
+        size_t bytesUsed() const { return tapeSize*sizeof(uint64_t) + numberCount*sizeof(double) + stringBytes; }
+};
+
+//                                                  ---- Tape Parser Class ----
+/**
+ * @brief Recursive descent parser (same grammar as Parser) that writes to a TapeDocument
+ */
+class TapeParser {
+    private:
+        void parseValue();
+        void parseObject();
+        void parseArray();
+        void parseString();
+        void parseNumber();
+        void parseKeyword();
+
+        void expect(TokenType type);
+        void append(TapeType type, uint64_t payload);
+        uint64_t appendString(std::string_view value);
+
+        Lexer& lexer;
+        Token currentToken;
+        TapeDocument* doc;
+        size_t inputSize;
+    public:
+        /**
+         * @brief Constructor for the TapeParser
+         * @param lexer The lexer to use for tokenization
+         * @param inputSize Size of the lexer's input, used to bound the arena reservation
+         */
+        TapeParser(Lexer& lexer, size_t inputSize);
+
+        /**
+         * @brief Parse the whole input into a new document
+         */
+        TapeDocument parse();
+};
+
+#endif // JSON_TAPE_HPP
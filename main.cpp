@@ -1,29 +1,176 @@
 #include <exception>
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
 #include "haversine_formula.cpp"
+#include "haversine_batch.cpp"
+#include "haversine_reduce.cpp"
+#include "pair_file.cpp"
+#include "pair_cache.cpp"
+#include "json/json_input.hpp"
 #include "json/json_parser.hpp"
+#include "json/json_tape.hpp"
+#include "json/json_events.hpp"
+#include "json/json_schema.hpp"
+#include "json/json_parallel.hpp"
+#include "json/json_lazy.hpp"
 #include "timer.cpp"
+#include "profiler/Profiler.h"
 
-std::string readFile(const std::string& filename) {
-    std::ifstream file(filename);
-    if (!file.is_open()){
-        throw std::runtime_error("Could not open file: " + filename);
+// Shape of the generator's output, bound at compile time for --schema
+struct HaversinePair {
+    double x0, y0, x1, y1;
+};
+
+template <>
+struct JsonSchema<HaversinePair> {
+    static constexpr auto fields = std::make_tuple(
+        jsonField("x0", &HaversinePair::x0), jsonField("y0", &HaversinePair::y0),
+        jsonField("x1", &HaversinePair::x1), jsonField("y1", &HaversinePair::y1));
+};
+
+struct HaversineInput {
+    JsonColumns<HaversinePair> pairs;
+};
+
+template <>
+struct JsonSchema<HaversineInput> {
+    static constexpr auto fields = std::make_tuple(jsonField("pairs", &HaversineInput::pairs));
+};
+
+// Sums the pairs straight from the event stream, only the pair being read is kept in memory.
+// Expected shape: {"pairs":[{"x0":..,"y0":..,"x1":..,"y1":..}, ...]}
+// The pair count is only known at the end, so the distances are summed first and scaled once.
+// A pair missing a coordinate throws the same std::out_of_range as JsonObject::at() in the other modes.
+static double SumHaversineEvents(EventReader &Reader, u64 &PairCount, double EarthRadius) {
+    double Sum = 0;
+    double Coords[4] = {};
+    unsigned SeenCoords = 0;   // bit i set once Coords[i] was read in the current pair
+    int CoordIndex = -1;
+    bool InPairs = false;
+    PairCount = 0;
+
+    for (JsonEvent Event = Reader.next(); Event != JsonEvent::END_DOCUMENT; Event = Reader.next()){
+        switch (Event){
+            case JsonEvent::KEY:
+                if (Reader.depth() == 1){
+                    InPairs = (Reader.text() == "pairs");
+                } else if (InPairs && Reader.depth() == 3){
+                    std::string_view Key = Reader.text();
+                    CoordIndex = -1;
+                    if (Key == "x0") CoordIndex = 0;
+                    else if (Key == "y0") CoordIndex = 1;
+                    else if (Key == "x1") CoordIndex = 2;
+                    else if (Key == "y1") CoordIndex = 3;
+                }
+                break;
+            case JsonEvent::NUMBER:
+                if (InPairs && Reader.depth() == 3 && CoordIndex >= 0){
+                    Coords[CoordIndex] = Reader.number();
+                    SeenCoords |= 1u << CoordIndex;
+                }
+                break;
+            case JsonEvent::START_OBJECT:
+                // A pair starts (the depth already counts it)
+                if (InPairs && Reader.depth() == 3){
+                    SeenCoords = 0;
+                }
+                break;
+            case JsonEvent::END_OBJECT:
+                if (InPairs && Reader.depth() == 2){
+                    if (SeenCoords != 0xF){
+                        throw std::out_of_range("key not found in object");
+                    }
+                    Sum += ReferenceHaversine(Coords[0], Coords[1], Coords[2], Coords[3], EarthRadius);
+                    ++PairCount;
+                    CoordIndex = -1;
+                }
+                break;
+            case JsonEvent::END_ARRAY:
+                if (Reader.depth() == 1){
+                    InPairs = false;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    return PairCount ? Sum / (double)PairCount : 0;
+}
+
+// Sums the pairs of the "pairs" array of a document, for any of the document types (JsonArray,
+// TapeArray, LazyArray): the same loop for all of them, so the modes can not compute it differently.
+// Elements that are not objects are skipped.
+template <typename PairArray>
+static double SumHaversinePairs(PairArray const &Pairs, double EarthRadius) {
+    double Sum = 0;
+    double sumCoef = 1.0/(double)Pairs.size();
+    for (auto const &pairValue : Pairs) {
+        if (pairValue.isObject()){
+            auto const &pairObj = pairValue.asObject();
+
+            double x0 = pairObj.at("x0").asNumber();
+            double y0 = pairObj.at("y0").asNumber();
+            double x1 = pairObj.at("x1").asNumber();
+            double y1 = pairObj.at("y1").asNumber();
+
+            // 5. Compute Haversine distance
+            double HaversineDistance = ReferenceHaversine(x0, y0, x1, y1, EarthRadius);
+
+            Sum += sumCoef * HaversineDistance;
+        }
+    }
+    return Sum;
+}
+
+// Compensated and bit identical for any ThreadCount (see haversine_reduce.cpp). With Batch the vectorized
+// kernel of the widest ISA the CPU supports is used instead of ReferenceHaversine
+static double SumHaversineColumns(double const *X0, double const *Y0, double const *X1, double const *Y1, size_t PairCount, double EarthRadius, bool Batch, unsigned ThreadCount) {
+    PROFILE_BANDWIDTH("Sum", 4*sizeof(double)*PairCount);
+    if (PairCount == 0){
+        // An empty pair file averages to 0, like SumHaversineEvents
+        return 0;
+    }
+    double sumCoef = 1.0/(double)PairCount;
+    return sumCoef * SumHaversineParallel(X0, Y0, X1, Y1, PairCount, EarthRadius, Batch, ThreadCount);
+}
+
+// Bytes loading File really read: a mapping that is not prefaulted is only read later, page by page, while lexing
+static u64 LoadedBytes(InputFile const &File, bool Prefault) {
+    return (File.method() == InputMethod::READ || Prefault) ? File.size() : 0;
+}
+
+// Binary pair files are recognized by their magic, whatever their name
+static bool IsPairFile(std::string const &Path) {
+    char Magic[sizeof(PairFileMagic)];
+    FILE *File = fopen(Path.c_str(), "rb");
+    if (!File){
+        return false;
     }
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
+    size_t Size = fread(Magic, 1, sizeof(Magic), File);
+    fclose(File);
+    return HasPairFileMagic(Magic, Size);
 }
 
-static void PrintTimeElapsed(char const *label, uint64_t TotalTSCElapsed, uint64_t begin, uint64_t end) {
+static void PrintTimeElapsed(char const *label, uint64_t TotalTSCElapsed, uint64_t begin, uint64_t end, u64 ByteCount = 0, u64 CPUFreq = 0) {
     uint64_t Elapsed = end - begin;
     double Percent = 100.0 * ((double)Elapsed / (double)TotalTSCElapsed);
-    std::cout << label << " took " << Elapsed << " TSC ticks (" << Percent << "% of total)" << std::endl;
+    std::cout << label << " took " << Elapsed << " TSC ticks (" << Percent << "% of total)";
+    if (ByteCount && CPUFreq && Elapsed){
+        double Seconds = (double)Elapsed / (double)CPUFreq;
+        std::cout << " " << (double)ByteCount / 1e9 / Seconds << " GB/s";
+    }
+    std::cout << std::endl;
 }
 
 int main(int ArgCount, char **Args) {
+    // Only with -DPROFILING_ENABLED=1: a trace in profile_results.json, or with -DPROFILING_ZONES=1 a table of the zones
+    PROFILE_SESSION("haversine", "profile_results.json");
 
     u64 ProfileBegin = 0;
     u64 ProfileRead = 0;
@@ -35,55 +182,251 @@ int main(int ArgCount, char **Args) {
 
     ProfileBegin = ReadCPUTimer();
 
-    if (ArgCount != 2){
-        std::cerr << "Usage: " << Args[0] << " <json_file>" << std::endl;
+    // --dom parses into the JsonValue tree instead of the (default) flat tape document
+    // --stream never builds a document, the sum is computed from parser events as they come, and the
+    //   file is read through a fixed window (--window N megabytes) so memory does not grow with it,
+    //   by a read-ahead thread unless --no-readahead is given
+    // --schema parses straight into packed x0/y0/x1/y1 columns
+    // --lazy only parses the values the sum actually reads, when it reads them
+    // --threads N parses the JsonValue tree (so it implies --dom) with up to N threads, and sums columns
+    //   (--schema, pair files and --cache) on N threads
+    // --read loads the file with read() instead of mapping it, --prefault faults the whole mapping in during "Read"
+    // A binary pair file (haversine_point_generator --binary) is detected and summed in place, whatever the mode
+    // --cache reuses the pairs extracted by a previous run from <json_file>.pairs, if that sidecar is missing,
+    //   stale or corrupt the file is parsed with --schema and the sidecar is (re)written
+    // --batch sums columns (--schema, pair files and --cache) with the vectorized kernel instead of ReferenceHaversine
+    bool UseDOM = false;
+    InputMethod ReadMethod = InputMethod::MMAP;
+    bool Prefault = false;
+    bool UseStream = false;
+    size_t StreamWindow = Lexer::DEFAULT_WINDOW;
+    bool ReadAhead = true;
+    bool UseSchema = false;
+    bool UseLazy = false;
+    bool UseCache = false;
+    bool UseBatch = false;
+    unsigned ThreadCount = 1;
+    char const *JsonFileArg = nullptr;
+    for (int ArgIndex = 1; ArgIndex < ArgCount; ++ArgIndex){
+        std::string Arg = Args[ArgIndex];
+        if (Arg == "--dom"){
+            UseDOM = true;
+        } else if (Arg == "--threads" && ArgIndex + 1 < ArgCount && atoi(Args[ArgIndex + 1]) > 0){
+            ThreadCount = (unsigned)atoi(Args[++ArgIndex]);
+            UseDOM = true;
+        } else if (Arg == "--read"){
+            ReadMethod = InputMethod::READ;
+        } else if (Arg == "--prefault"){
+            Prefault = true;
+        } else if (Arg == "--stream"){
+            UseStream = true;
+        } else if (Arg == "--no-readahead"){
+            ReadAhead = false;
+        } else if (Arg == "--window" && ArgIndex + 1 < ArgCount && atoi(Args[ArgIndex + 1]) > 0){
+            StreamWindow = (size_t)atoi(Args[++ArgIndex]) * 1024 * 1024;
+        } else if (Arg == "--schema"){
+            UseSchema = true;
+        } else if (Arg == "--lazy"){
+            UseLazy = true;
+        } else if (Arg == "--cache"){
+            UseCache = true;
+        } else if (Arg == "--batch"){
+            UseBatch = true;
+        } else if (!JsonFileArg){
+            JsonFileArg = Args[ArgIndex];
+        } else {
+            JsonFileArg = nullptr;
+            break;
+        }
+    }
+    if (!JsonFileArg){
+        std::cerr << "Usage: " << Args[0] << " [--dom | --threads N | --stream [--window N] [--no-readahead] | --schema | --lazy] [--cache] [--batch] [--read | --prefault] <json_file | pair_file>" << std::endl;
         return 1;
     }
 
-    std::string jsonFile = Args[1];
+    std::string jsonFile = JsonFileArg;
+    u64 ReadBytes = 0;
     try {
         ProfileRead = ReadCPUTimer();
-        // 1. Read the JSON file
-        std::string jsonData = readFile(jsonFile);
+        u64 OSReadBegin = ReadOSTimer();
+        // 1. Read the JSON file (mapped, so unless it is prefaulted most of the reading really happens while lexing)
+        //    When streaming it is only opened here, and read window by window by the lexer
+        std::optional<InputFile> jsonInput;
+        std::optional<FileStream> jsonStream;
+        std::optional<ReadAheadStream> jsonReadAhead;
+        InputStream *StreamSource = nullptr;
+        std::string_view jsonData;
+        bool UseBinary = IsPairFile(jsonFile);
+        bool PairFileChecked = false;
+        pair_cache_key CacheKey = {};
+        std::string CachePath = PairCachePath(jsonFile);
+        char const *CacheMiss = nullptr;
+        if (UseCache && !UseBinary){
+            if (!ReadPairCacheKey(jsonFile.c_str(), &CacheKey)){
+                throw std::runtime_error("Could not open file: " + jsonFile);
+            }
+            CacheMiss = "no sidecar";
+            if (access(CachePath.c_str(), R_OK) == 0){
+                jsonInput.emplace(CachePath, ReadMethod, Prefault);
+                CacheMiss = CheckPairCache(jsonInput->data().data(), jsonInput->size(), CacheKey);
+            }
+            if (CacheMiss){
+                // The sidecar is rebuilt from the columns the schema reader produces
+                jsonInput.reset();
+                UseSchema = true;
+                UseStream = false;
+            } else {
+                pair_cache_header CacheHeader;
+                memcpy(&CacheHeader, jsonInput->data().data(), sizeof(CacheHeader));
+                jsonData = jsonInput->data().substr(sizeof(CacheHeader));
+                ReadBytes = LoadedBytes(*jsonInput, Prefault);
+                UseBinary = true;
+                PairFileChecked = true;
+                double LoadSeconds = (double)(ReadOSTimer() - OSReadBegin) / (double)GetOSTimerFreq();
+                std::cout << "Cache hit (" << CachePath << "): loaded in " << LoadSeconds << " s, saved "
+                          << CacheHeader.ParseSeconds - LoadSeconds << " s of reading and parsing" << std::endl;
+            }
+        }
+        if (UseBinary){
+            UseStream = false;
+        }
+        if (UseBatch && !UseBinary && !UseSchema){
+            std::cerr << "Warning: --batch only applies to column sums (--schema, pair files and --cache), "
+                      << "this run sums with ReferenceHaversine" << std::endl;
+        }
+        if (jsonInput){
+            // Cache hit, the pair file inside the sidecar is already loaded
+        } else if (UseStream){
+            jsonStream.emplace(jsonFile);
+            StreamSource = &*jsonStream;
+            if (ReadAhead){
+                jsonReadAhead.emplace(*jsonStream);
+                StreamSource = &*jsonReadAhead;
+            }
+        } else {
+            jsonInput.emplace(jsonFile, ReadMethod, Prefault);
+            jsonData = jsonInput->data();
+            ReadBytes = LoadedBytes(*jsonInput, Prefault);
+        }
         ProfileMiscSetup = ReadCPUTimer();
         std::cout << "---Parsing JSON DATA---" << std::endl;
         // 2. Lexer (Tokenizes the JSON data) 
-        Lexer lexer(jsonData);
-        // 3. Parser (Parses the JSON data)
-        Parser parser(lexer);
-        // 4. Parse the JSON data
+        Lexer lexer = UseStream ? Lexer(*StreamSource, StreamWindow) : Lexer(jsonData);
+        double EarthRadius = 6371.8;
+        // 3. Parser (Parses the JSON data) and 4. Parse the JSON data
         ProfileParseJSON = ReadCPUTimer();
-        JsonValue parsedJSON = parser.parse();
-        std::cout << "---JSON Parsed Successfully---" << std::endl;
-        if (parsedJSON.isObject()){
-            JsonObject root = parsedJSON.asObject();
-            if (root.count("pairs") && root.at("pairs").isArray()){
-                JsonArray pairs = root.at("pairs").asArray();
-                std::cout << "Found " << pairs.size() << " pairs" << std::endl;
-                ProfileSum = ReadCPUTimer();
-                double Sum = 0;
-                double sumCoef = 1.0/(double)pairs.size();
-                for (size_t i = 0; i < pairs.size(); ++i) {
-                    JsonValue &pairValue = pairs[i];
-
-                    if (pairValue.isObject()){
-                        JsonObject pairObj = pairValue.asObject();
-
-                        double x0 = pairObj.at("x0").asNumber();
-                        double y0 = pairObj.at("y0").asNumber();
-                        double x1 = pairObj.at("x1").asNumber();
-                        double y1 = pairObj.at("y1").asNumber();
-
-                        // 5. Compute Haversine distance
-                        double EarthRadius = 6371.8;
-                        double HaversineDistance = ReferenceHaversine(x0, y0, x1, y1, EarthRadius);
-
-                        Sum += sumCoef * HaversineDistance;
-                    }
+        if (UseBinary){
+            // Nothing to parse: once the header and checksum are verified the columns are used in place
+            if (char const *Error = PairFileChecked ? nullptr : CheckPairFile(jsonData.data(), jsonData.size())){
+                throw std::runtime_error(std::string("Invalid pair file: ") + Error);
+            }
+            pair_file_header Header;
+            memcpy(&Header, jsonData.data(), sizeof(Header));
+            std::cout << "---Pair File Checked---" << std::endl;
+            std::cout << "Found " << Header.PairCount << " pairs" << std::endl;
+            ProfileSum = ReadCPUTimer();
+            double Sum = SumHaversineColumns(PairColumn(jsonData.data(), 0), PairColumn(jsonData.data(), 1),
+                                             PairColumn(jsonData.data(), 2), PairColumn(jsonData.data(), 3),
+                                             Header.PairCount, EarthRadius, UseBatch, ThreadCount);
+            ProfileMiscOutput = ReadCPUTimer();
+            std::cout << "Sum of Haversine distances: " << Sum << std::endl;
+            if (Header.Method != PairMethod_Parsed){
+                std::cout << "Expected sum (from the generator): " << Header.ExpectedSum << std::endl;
+            }
+            ProfileEnd = ReadCPUTimer();
+        } else if (UseStream){
+            // Reading, parsing and summing are interleaved, so all of it shows up under "Parse JSON"
+            EventReader reader(lexer);
+            u64 PairCount = 0;
+            double Sum = SumHaversineEvents(reader, PairCount, EarthRadius);
+            std::cout << "---JSON Streamed Successfully---" << std::endl;
+            std::cout << "Found " << PairCount << " pairs" << std::endl;
+            if (jsonReadAhead){
+                // Whichever side waited more is the one that was ahead. The reading happened during "Parse JSON",
+                // the "Read" interval only opened the file, so the bandwidth is given here instead
+                ReadAheadStream::Stats Stats = jsonReadAhead->stats();
+                std::cout << "Read-ahead: " << Stats.bytes << " bytes read in " << Stats.readSeconds << " s";
+                if (Stats.readSeconds > 0){
+                    std::cout << " (" << (double)Stats.bytes / 1e9 / Stats.readSeconds << " GB/s)";
+                }
+                std::cout << ", parser stalled " << Stats.consumerStalled << " s, reader stalled " << Stats.readerStalled << " s" << std::endl;
+            }
+            ProfileSum = ReadCPUTimer();
+            ProfileMiscOutput = ReadCPUTimer();
+            std::cout << "Sum of Haversine distances: " << Sum << std::endl;
+            ProfileEnd = ReadCPUTimer();
+        } else if (UseSchema){
+            SchemaReader reader(lexer);
+            HaversineInput input = reader.parse<HaversineInput>();
+            std::cout << "---JSON Parsed Successfully---" << std::endl;
+            size_t PairCount = input.pairs.size();
+            std::cout << "Found " << PairCount << " pairs" << std::endl;
+            ProfileSum = ReadCPUTimer();
+            double ParseSeconds = (double)(ReadOSTimer() - OSReadBegin) / (double)GetOSTimerFreq();
+            double Sum = SumHaversineColumns(input.pairs.column(0).data(), input.pairs.column(1).data(),
+                                             input.pairs.column(2).data(), input.pairs.column(3).data(),
+                                             PairCount, EarthRadius, UseBatch, ThreadCount);
+            ProfileMiscOutput = ReadCPUTimer();
+            std::cout << "Sum of Haversine distances: " << Sum << std::endl;
+            if (CacheMiss){
+                double const *Columns[4] = {input.pairs.column(0).data(), input.pairs.column(1).data(),
+                                            input.pairs.column(2).data(), input.pairs.column(3).data()};
+                bool Written = WritePairCache(CachePath, CacheKey, ParseSeconds, Columns, PairCount);
+                std::cout << "Cache miss (" << CacheMiss << "): parsed in " << ParseSeconds << " s, "
+                          << (Written ? "wrote " : "could not write ") << CachePath << std::endl;
+            }
+            ProfileEnd = ReadCPUTimer();
+        } else if (UseLazy){
+            LazyDocument document(jsonData);
+            LazyValue parsedJSON = document.root();
+            std::cout << "---JSON Opened Lazily---" << std::endl;
+            if (parsedJSON.isObject()){
+                LazyObject root = parsedJSON.asObject();
+                if (root.count("pairs") && root.at("pairs").isArray()){
+                    LazyArray pairs = root.at("pairs").asArray();
+                    std::cout << "Found " << pairs.size() << " pairs" << std::endl;
+                    ProfileSum = ReadCPUTimer();
+                    double Sum = SumHaversinePairs(pairs, EarthRadius);
+                    ProfileMiscOutput = ReadCPUTimer();
+                    std::cout << "Sum of Haversine distances: " << Sum << std::endl;
+                    ProfileEnd = ReadCPUTimer();
+                }
+            }
+        } else if (UseDOM){
+            ParallelParser parser(jsonData, ThreadCount);
+            JsonValue parsedJSON = parser.parse();
+            std::cout << "---JSON Parsed Successfully---" << std::endl;
+            if (ThreadCount > 1){
+                std::cout << "Parsed in " << parser.chunkCount() << " chunks (" << ThreadCount << " threads)" << std::endl;
+            }
+            if (parsedJSON.isObject()){
+                JsonObject const &root = parsedJSON.asObject();
+                if (root.count("pairs") && root.at("pairs").isArray()){
+                    JsonArray const &pairs = root.at("pairs").asArray();
+                    std::cout << "Found " << pairs.size() << " pairs" << std::endl;
+                    ProfileSum = ReadCPUTimer();
+                    double Sum = SumHaversinePairs(pairs, EarthRadius);
+                    ProfileMiscOutput = ReadCPUTimer();
+                    std::cout << "Sum of Haversine distances: " << Sum << std::endl;
+                    ProfileEnd = ReadCPUTimer();
+                }
+            }
+        } else {
+            TapeParser tapeParser(lexer, jsonData.size());
+            TapeDocument document = tapeParser.parse();
+            std::cout << "---JSON Parsed Successfully---" << std::endl;
+            TapeValue parsedJSON = document.root();
+            if (parsedJSON.isObject()){
+                TapeObject root = parsedJSON.asObject();
+                if (root.count("pairs") && root.at("pairs").isArray()){
+                    TapeArray pairs = root.at("pairs").asArray();
+                    std::cout << "Found " << pairs.size() << " pairs" << std::endl;
+                    ProfileSum = ReadCPUTimer();
+                    double Sum = SumHaversinePairs(pairs, EarthRadius);
+                    ProfileMiscOutput = ReadCPUTimer();
+                    std::cout << "Sum of Haversine distances: " << Sum << std::endl;
+                    ProfileEnd = ReadCPUTimer();
                 }
-                ProfileMiscOutput = ReadCPUTimer();
-                std::cout << "Sum of Haversine distances: " << Sum << std::endl;
-                ProfileEnd = ReadCPUTimer();
             }
         }
     } catch (const std::exception &err){
@@ -95,7 +438,7 @@ int main(int ArgCount, char **Args) {
         std::cout << "Total Time: " << (double)TotalTSCElapsed / (double)CPUFreq << " seconds" << "( CPU Freq: " << CPUFreq / 1000000000 << " GHz)" << std::endl;
     }
 
-    PrintTimeElapsed("Read", TotalTSCElapsed, ProfileRead, ProfileMiscSetup);
+    PrintTimeElapsed("Read", TotalTSCElapsed, ProfileRead, ProfileMiscSetup, ReadBytes, CPUFreq);
     PrintTimeElapsed("Misc Setup", TotalTSCElapsed, ProfileMiscSetup, ProfileParseJSON);
     PrintTimeElapsed("Parse JSON", TotalTSCElapsed, ProfileParseJSON, ProfileSum);
     PrintTimeElapsed("Sum", TotalTSCElapsed, ProfileSum, ProfileMiscOutput);
@@ -0,0 +1,137 @@
+// Sidecar cache of the pairs extracted from a JSON file, so that repeated runs over the same input
+// skip lexing and parsing. The sidecar (<json file>.pairs) is a 64 byte header identifying the
+// source it was made from, followed by a pair file (pair_file.cpp, which must be included first).
+// The source is identified by its size, modification time and a hash of samples of its content:
+// a cheap guard against using the pairs of another file, not a proof that no byte changed.
+#include <stdio.h>
+#include <string>
+#include <sys/stat.h>
+
+#define PairCacheVersion 1
+#define PairCacheSampleSize 4096
+#define PairCacheSampleCount 256
+
+static char const PairCacheMagic[8] = {'H', 'A', 'V', 'C', 'A', 'C', 'H', 'E'};
+
+struct pair_cache_key {
+    u64 SourceSize;
+    u64 SourceTime;      // modification time in nanoseconds
+    u64 SourceHash;      // SampledHash of the content
+};
+
+struct pair_cache_header {
+    char Magic[8];
+    u32 Version;
+    u32 Reserved0;
+    pair_cache_key Key;
+    double ParseSeconds; // how long reading and parsing the source took when the sidecar was written
+    u64 Reserved[2];
+};
+static_assert(sizeof(pair_cache_header) == PairFileAlignment, "the pair file must start aligned");
+
+static std::string PairCachePath(std::string const &Source){
+    std::string Result = Source + ".pairs";
+    return Result;
+}
+
+// Evenly spaced samples (the first and the last included), or everything for small files
+static u64 SampledHash(char const *Data, u64 Size){
+    u64 SampleSize = PairCacheSampleSize;
+    u64 SampleCount = PairCacheSampleCount;
+    if (Size <= SampleSize*SampleCount){
+        SampleSize = Size;
+        SampleCount = 1;
+    }
+
+    u64 Hash = ChecksumRound(0, Size);
+    for (u64 Sample = 0; Sample < SampleCount; ++Sample){
+        u64 Offset = (SampleCount > 1) ? (Sample*(Size - SampleSize) / (SampleCount - 1)) : 0;
+        for (u64 At = 0; At < SampleSize; At += sizeof(u64)){
+            u64 Word = 0;
+            memcpy(&Word, Data + Offset + At, (SampleSize - At < sizeof(u64)) ? (SampleSize - At) : sizeof(u64));
+            Hash = ChecksumRound(Hash, Word);
+        }
+    }
+    return Hash;
+}
+
+static bool ReadPairCacheKey(char const *Path, pair_cache_key *Key){
+    int File = open(Path, O_RDONLY);
+    if (File < 0){
+        return false;
+    }
+
+    bool Result = false;
+    struct stat Info;
+    if ((fstat(File, &Info) == 0) && S_ISREG(Info.st_mode)){
+        Key->SourceSize = (u64)Info.st_size;
+        Key->SourceTime = (u64)Info.st_mtim.tv_sec*1000000000ULL + (u64)Info.st_mtim.tv_nsec;
+        Key->SourceHash = SampledHash("", 0);
+        Result = true;
+        if (Key->SourceSize){
+            // Mapped, so only the sampled pages are read
+            void *Memory = mmap(0, Key->SourceSize, PROT_READ, MAP_PRIVATE, File, 0);
+            if (Memory != MAP_FAILED){
+                Key->SourceHash = SampledHash((char const *)Memory, Key->SourceSize);
+                munmap(Memory, Key->SourceSize);
+            } else {
+                Result = false;
+            }
+        }
+    }
+    close(File);
+    return Result;
+}
+
+// Returns 0 if Data holds a sidecar made from the source Key describes, with an intact pair file,
+// otherwise why it can't be used
+static char const *CheckPairCache(void const *Data, u64 Size, pair_cache_key const &Key){
+    if ((Size < sizeof(pair_cache_header)) || (memcmp(Data, PairCacheMagic, sizeof(PairCacheMagic)) != 0)){
+        return "not a pair cache";
+    }
+
+    pair_cache_header Header;
+    memcpy(&Header, Data, sizeof(Header));
+    if (Header.Version != PairCacheVersion){
+        return "unsupported pair cache version";
+    }
+    if ((Header.Key.SourceSize != Key.SourceSize) || (Header.Key.SourceTime != Key.SourceTime) ||
+        (Header.Key.SourceHash != Key.SourceHash)){
+        return "the source changed";
+    }
+
+    char const *Result = CheckPairFile((char const *)Data + sizeof(Header), Size - sizeof(Header));
+    return Result;
+}
+
+// Written next to the final path and renamed over it, so a sidecar is either complete or absent
+static bool WritePairCache(std::string const &CachePath, pair_cache_key const &Key, double ParseSeconds,
+                           double const *Columns[4], u64 PairCount){
+    std::string TempPath = CachePath + ".tmp";
+    pair_file_output Output;
+    if (!CreatePairFile(TempPath.c_str(), PairCount, sizeof(pair_cache_header), &Output)){
+        return false;
+    }
+
+    for (u32 Column = 0; Column < 4; ++Column){
+        memcpy(Output.Columns[Column], Columns[Column], PairCount*sizeof(double));
+    }
+
+    pair_cache_header CacheHeader = {};
+    memcpy(CacheHeader.Magic, PairCacheMagic, sizeof(CacheHeader.Magic));
+    CacheHeader.Version = PairCacheVersion;
+    CacheHeader.Key = Key;
+    CacheHeader.ParseSeconds = ParseSeconds;
+    memcpy(Output.Base, &CacheHeader, sizeof(CacheHeader));
+
+    pair_file_header Header = {};
+    Header.Method = PairMethod_Parsed;
+    Header.PairCount = PairCount;
+    FinishPairFile(&Output, &Header);
+
+    bool Result = (rename(TempPath.c_str(), CachePath.c_str()) == 0);
+    if (!Result){
+        unlink(TempPath.c_str());
+    }
+    return Result;
+}
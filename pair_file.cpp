@@ -0,0 +1,151 @@
+// Binary pair file, the CPU friendly alternative to the JSON the generator writes.
+// A 64 byte header is followed by the x0, y0, x1 and y1 columns, each a contiguous array of
+// PairCount doubles starting on a 64 byte boundary (zero padded in between), in native byte
+// order. Mapped read only, the columns are used in place: there is nothing to parse.
+// Programs only use the reading or the writing half, so both halves are marked [[maybe_unused]].
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+#define PairFileVersion 1
+#define PairFileAlignment 64
+
+static char const PairFileMagic[8] = {'H', 'A', 'V', 'P', 'A', 'I', 'R', 'S'};
+
+enum pair_method : u32 {
+    PairMethod_Uniform,
+    PairMethod_Cluster,
+    PairMethod_Parsed,   // extracted from a JSON file, there is no seed or expected sum
+};
+
+struct pair_file_header {
+    char Magic[8];
+    u32 Version;
+    u32 Method;          // pair_method
+    u64 PairCount;
+    u64 Seed;
+    double ExpectedSum;  // reference sum computed by the generator
+    u64 Checksum;        // PairFileChecksum of everything after the header
+    u64 Reserved[2];
+};
+static_assert(sizeof(pair_file_header) == PairFileAlignment, "the first column must start aligned");
+
+static u64 PairColumnOffset(u64 PairCount, u32 Column){
+    u64 ColumnSize = (PairCount*sizeof(double) + PairFileAlignment - 1) & ~(u64)(PairFileAlignment - 1);
+    u64 Result = sizeof(pair_file_header) + Column*ColumnSize;
+    return Result;
+}
+
+static u64 PairFileSize(u64 PairCount){
+    u64 Result = PairColumnOffset(PairCount, 4);
+    return Result;
+}
+
+static u64 ChecksumRound(u64 Hash, u64 Word){
+    Hash += Word * 0xC2B2AE3D27D4EB4FULL;
+    Hash = (Hash << 31) | (Hash >> 33);
+    Hash *= 0x9E3779B97F4A7C15ULL;
+    return Hash;
+}
+
+// Four independent lanes over 64 bit words so the multiplies overlap, Size is a multiple of 64
+static u64 PairFileChecksum(void const *Data, u64 Size){
+    u64 Lanes[4] = {1, 2, 3, 4};
+    unsigned char const *Bytes = (unsigned char const *)Data;
+    for (u64 Offset = 0; Offset < Size; Offset += 4*sizeof(u64)){
+        u64 Words[4];
+        memcpy(Words, Bytes + Offset, sizeof(Words));
+        for (int Lane = 0; Lane < 4; ++Lane){
+            Lanes[Lane] = ChecksumRound(Lanes[Lane], Words[Lane]);
+        }
+    }
+
+    u64 Result = Size;
+    for (int Lane = 0; Lane < 4; ++Lane){
+        Result = ChecksumRound(Result, Lanes[Lane]);
+    }
+    return Result;
+}
+
+static bool HasPairFileMagic(void const *Data, u64 Size){
+    bool Result = (Size >= sizeof(PairFileMagic)) && (memcmp(Data, PairFileMagic, sizeof(PairFileMagic)) == 0);
+    return Result;
+}
+
+// Returns 0 if Data holds a complete pair file of this version, otherwise what is wrong with it
+[[maybe_unused]] static char const *CheckPairFile(void const *Data, u64 Size){
+    if (!HasPairFileMagic(Data, Size) || (Size < sizeof(pair_file_header))){
+        return "not a pair file";
+    }
+
+    pair_file_header Header;
+    memcpy(&Header, Data, sizeof(Header));
+    if (Header.Version != PairFileVersion){
+        return "unsupported pair file version";
+    }
+    if ((Header.PairCount > (Size / sizeof(double))) || (PairFileSize(Header.PairCount) != Size)){
+        return "pair file size does not match its pair count";
+    }
+    if (PairFileChecksum((char const *)Data + sizeof(Header), Size - sizeof(Header)) != Header.Checksum){
+        return "pair file checksum mismatch";
+    }
+
+    return 0;
+}
+
+[[maybe_unused]] static double const *PairColumn(void const *Data, u32 Column){
+    pair_file_header const *Header = (pair_file_header const *)Data;
+    double const *Result = (double const *)((char const *)Data + PairColumnOffset(Header->PairCount, Column));
+    return Result;
+}
+
+// A pair file is written in place through a shared mapping, so the columns can be filled in any
+// order (and by any thread). Prefix bytes (a multiple of 64) are left for the caller before it.
+struct pair_file_output {
+    int File;
+    char *Base;          // start of the file, the pair file itself starts at Base + Prefix
+    u64 Prefix;
+    u64 Size;
+    double *Columns[4];
+};
+
+[[maybe_unused]] static bool CreatePairFile(char const *Path, u64 PairCount, u64 Prefix, pair_file_output *Output){
+    Output->Prefix = Prefix;
+    Output->Size = Prefix + PairFileSize(PairCount);
+    Output->File = open(Path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    Output->Base = 0;
+    if ((Output->File >= 0) && (ftruncate(Output->File, (off_t)Output->Size) == 0)){
+        void *Memory = mmap(0, Output->Size, PROT_READ | PROT_WRITE, MAP_SHARED, Output->File, 0);
+        if (Memory != MAP_FAILED){
+            Output->Base = (char *)Memory;
+        }
+    }
+
+    if (!Output->Base){
+        if (Output->File >= 0) close(Output->File);
+        return false;
+    }
+
+    for (u32 Column = 0; Column < 4; ++Column){
+        Output->Columns[Column] = (double *)(Output->Base + Prefix + PairColumnOffset(PairCount, Column));
+    }
+    return true;
+}
+
+// Fills in the magic, version and checksum of Header and writes it last, so a file whose writing
+// was interrupted is never valid. The file is unmapped and closed.
+[[maybe_unused]] static void FinishPairFile(pair_file_output *Output, pair_file_header *Header){
+    char *PairFile = Output->Base + Output->Prefix;
+    memcpy(Header->Magic, PairFileMagic, sizeof(Header->Magic));
+    Header->Version = PairFileVersion;
+    Header->Checksum = PairFileChecksum(PairFile + sizeof(*Header), PairFileSize(Header->PairCount) - sizeof(*Header));
+    memcpy(PairFile, Header, sizeof(*Header));
+
+    munmap(Output->Base, Output->Size);
+    close(Output->File);
+}
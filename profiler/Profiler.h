@@ -1,14 +1,24 @@
 #pragma once 
 
 #include <string>
-#include <chrono>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
 #include <fstream>
+#include <iomanip>
+#include <memory>
 #include <thread>
 #include <mutex>
+#include <unordered_map>
 #include <vector>
 #include <iostream>
 #include <x86intrin.h>
+#include "../timer.cpp"
 
 using std::string;
 using std::hash;
@@ -19,50 +29,377 @@ using std::mutex;
 
 using namespace std::this_thread;
 using u32 = uint32_t;
-using ll = long long;
-using Clock = std::chrono::high_resolution_clock;
-using TimePoint = std::chrono::time_point<std::chrono::high_resolution_clock>;
+
+// Define PROFILE_SERIALIZED_TIMER as 1 to fence the timer reads, so the CPU cannot move the
+// instructions of short scopes across them (at the cost of a slower read)
+#ifndef PROFILE_SERIALIZED_TIMER
+    #define PROFILE_SERIALIZED_TIMER 0
+#endif
+
+// Define PROFILING_ZONES as 1 to aggregate each PROFILE_SCOPE / PROFILE_FUNCTION site into a zone
+// (hit count, inclusive and exclusive time) instead of recording every execution, the session then
+// prints a table of the zones instead of writing a trace
+#ifndef PROFILING_ZONES
+    #define PROFILING_ZONES 0
+#endif
+
+// Define PROFILE_STREAM_TRACE as 1 to have the session write its trace as it goes, in the binary
+// format below, to <filePath>.trace from a background thread (profiler/trace_to_json.cpp turns it
+// into the usual JSON). Otherwise every event is kept until the session ends, and written then.
+#ifndef PROFILE_STREAM_TRACE
+    #define PROFILE_STREAM_TRACE 0
+#endif
+
+// How often the background thread of PROFILE_STREAM_TRACE writes out the new events
+#ifndef PROFILE_STREAM_INTERVAL_MS
+    #define PROFILE_STREAM_INTERVAL_MS 20
+#endif
+
+// Define PROFILE_PERF_COUNTERS as 1 to also count hardware events in every scope, with Linux
+// perf_event_open counters opened per thread: cycles, instructions, LLC misses, branch misses and
+// page faults (or the set given to Profiler::set_perf_counters). Each scope then costs two read()
+// system calls. Counters that cannot be opened (no PMU, perf_event_paranoid) are left out.
+#ifndef PROFILE_PERF_COUNTERS
+    #define PROFILE_PERF_COUNTERS 0
+#endif
+
+// Define PROFILE_SAMPLING as 1 to also sample the call stacks of the program during the session,
+// PROFILE_SAMPLE_HZ times per second of CPU time (SIGPROF), each with the PROFILE_SCOPE it was
+// taken in. The session then writes them as folded stacks, for flame graphs, to <filePath>.folded.
+// Stacks are walked through the frame pointers, so build with -fno-omit-frame-pointer.
+#ifndef PROFILE_SAMPLING
+    #define PROFILE_SAMPLING 0
+#endif
+
+#ifndef PROFILE_SAMPLE_HZ
+    #define PROFILE_SAMPLE_HZ 1000
+#endif
+
+// Samples a session can hold (reserved up front, 528 bytes each with the default depth, so 34 MB of
+// address space that only becomes resident as samples are taken; the ones past it are dropped),
+// and the frames kept of each stack, from the innermost one
+#ifndef PROFILE_MAX_SAMPLES
+    #define PROFILE_MAX_SAMPLES 65536
+#endif
+
+#ifndef PROFILE_SAMPLE_DEPTH
+    #define PROFILE_SAMPLE_DEPTH 64
+#endif
+
+// Event chunks (16384 events each) a thread's buffer allocates when the thread registers. Chunks
+// the session has drained (PROFILE_STREAM_TRACE) go back to their buffer to be reused, up to this
+// many, so a chunk is only allocated while recording when none is free; the session reports how
+// many were.
+#ifndef PROFILE_PREALLOCATED_CHUNKS
+    #define PROFILE_PREALLOCATED_CHUNKS 4
+#endif
+
+// Distinct zone names a program can have, the ones past it are left out of the table
+#ifndef PROFILE_MAX_ZONES
+    #define PROFILE_MAX_ZONES 1024
+#endif
+
+#if PROFILE_PERF_COUNTERS || PROFILE_SAMPLING
+    #include <cerrno>
+    #include <unistd.h>
+#endif
+
+#if PROFILE_PERF_COUNTERS
+    #include <linux/perf_event.h>
+    #include <sys/syscall.h>
+#endif
+
+#if PROFILE_SAMPLING
+    #include <csignal>
+    #include <cxxabi.h>
+    #include <dlfcn.h>
+    #include <elf.h>
+    #include <link.h>
+    #include <map>
+    #include <pthread.h>
+    #include <sys/time.h>
+    #include <ucontext.h>
+#endif
+
+// The hardware events PROFILE_PERF_COUNTERS counts, as bits for Profiler::set_perf_counters
+enum ProfileCounter : u32 {
+    PROFILE_CYCLES,
+    PROFILE_INSTRUCTIONS,
+    PROFILE_LLC_MISSES,
+    PROFILE_BRANCH_MISSES,
+    PROFILE_PAGE_FAULTS,
+
+    PROFILE_COUNTER_COUNT
+};
+
+constexpr u32 PROFILE_ALL_COUNTERS = (1u << PROFILE_COUNTER_COUNT) - 1;
+
+inline const char* profile_counter_name(u32 counter) {
+    static const char* const names[PROFILE_COUNTER_COUNT] = {
+        "cycles", "instructions", "LLC misses", "branch misses", "page faults"
+    };
+    return names[counter];
+}
+
+// Raw CPU timer (TSC) ticks, converted to time only when the results are written
+inline u64 read_profile_timer() {
+#if PROFILE_SERIALIZED_TIMER
+    return ReadCPUTimerSerialized();
+#else
+    return ReadCPUTimer();
+#endif
+}
+
+/**
+ * The totals of one zone in one thread.
+ * Only the owning thread writes them, the relaxed atomics only make reading them meanwhile safe.
+ * 
+ * @param hitCount How many times the zone was entered.
+ * @param inclusiveTicks Ticks spent in the zone and its children, recursive entries counted once.
+ * @param exclusiveTicks Ticks spent in the zone itself, without its children.
+ * @param byteCount Bytes processed by the zone (PROFILE_BANDWIDTH), over all its hits.
+ */
+struct ProfileZoneTotals {
+    std::atomic<u64> hitCount{0};
+    std::atomic<u64> inclusiveTicks{0};
+    std::atomic<u64> exclusiveTicks{0};
+    std::atomic<u64> byteCount{0};
+#if PROFILE_PERF_COUNTERS
+    std::atomic<u64> counters[PROFILE_COUNTER_COUNT] = {};  // inclusive, like inclusiveTicks
+#endif
+};
+
+// The zones of one thread, indexed by slot. Slot 0 stands for "no zone", the parent of the outermost zones.
+struct ProfileZoneTable {
+    ProfileZoneTotals zones[PROFILE_MAX_ZONES];
+    u32 current = 0;  // slot of the innermost open zone
+};
+
+// total += value, for a total only the calling thread writes (a plain add, no locked instruction)
+inline void add_profile_total(std::atomic<u64>& total, u64 value) {
+    total.store(total.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
 
 /**
  * A single result from the profiler.
  * 
- * @param name The name of the function or scope.
- * @param start The start time of the function or scope.
- * @param end The end time of the function or scope.
+ * @param name The name of the function or scope, a static string (a literal or __func__) that is never copied.
+ * @param start The CPU timer ticks at the start of the function or scope.
+ * @param end The CPU timer ticks at the end of the function or scope.
+ * @param bytes The bytes processed by the scope (PROFILE_BANDWIDTH), 0 if not given.
  * @param ThreadID The thread ID of the function or scope.
+ * @param counters The hardware events counted in the scope (PROFILE_PERF_COUNTERS), 0 for the counters not available.
  */
 struct ProfileResult {
-    string name;
-    ll start, end;
+    const char* name;
+    u64 start, end;
+    u64 bytes;
     u32 ThreadID;
+#if PROFILE_PERF_COUNTERS
+    u64 counters[PROFILE_COUNTER_COUNT];
+#endif
+};
+
+/**
+ * The results recorded by one thread, in a linked list of fixed size chunks.
+ * Only the owning thread writes: no lock, and a new chunk only once every CHUNK_SIZE results, taken
+ * from the chunks preallocated or drained before (allocated only if there are none left).
+ * The flushing thread reads each chunk up to the count published by the writer, and hands the
+ * chunks the writer has moved past back to it.
+ */
+class ProfileThreadBuffer {
+    public:
+        static constexpr size_t CHUNK_SIZE = 16384;
+
+        explicit ProfileThreadBuffer(u32 threadID):
+            threadID_(threadID), head_(new Chunk), tail_(head_) {
+            for (int i = 1; i < PROFILE_PREALLOCATED_CHUNKS; i++) {
+                Chunk* chunk = new Chunk;
+                chunk->next.store(spare_, std::memory_order_relaxed);
+                spare_ = chunk;
+                chunkCount_++;
+            }
+        }
+
+        ~ProfileThreadBuffer() {
+            delete_chunks_(head_);
+            delete_chunks_(spare_);
+            delete_chunks_(freed_.load(std::memory_order_acquire));
+        }
+
+        ProfileThreadBuffer(const ProfileThreadBuffer&) = delete;
+        ProfileThreadBuffer& operator=(const ProfileThreadBuffer&) = delete;
+
+        // Owning thread only
+        void record(const char* name, u64 start, u64 end, u64 bytes, const u64* counters) {
+            Chunk* chunk = tail_;
+            size_t count = chunk->count.load(std::memory_order_relaxed);
+            if (count == CHUNK_SIZE) {
+                Chunk* fresh = take_chunk_();
+                chunk->next.store(fresh, std::memory_order_release);
+                tail_ = chunk = fresh;
+                count = 0;
+            }
+            Event& event = chunk->events[count];
+            event.name = name;
+            event.start = start;
+            event.end = end;
+            event.bytes = bytes;
+#if PROFILE_PERF_COUNTERS
+            memcpy(event.counters, counters, sizeof(event.counters));
+#else
+            (void)counters;
+#endif
+            chunk->count.store(count + 1, std::memory_order_release);
+        }
+
+        // Flushing thread only: appends the results not drained yet, until results holds limit of them
+        void drain(vector<ProfileResult>& results, size_t limit) {
+            // Only up to where the writer is now, or a writer as fast as the flushing thread is never caught up with
+            Chunk* last = head_;
+            while (Chunk* next = last->next.load(std::memory_order_acquire)) {
+                last = next;
+            }
+            size_t lastCount = last->count.load(std::memory_order_acquire);
+
+            while (true) {
+                // Once there is a next chunk the writer never comes back to this one, it is full
+                size_t count = (head_ == last) ? lastCount : CHUNK_SIZE;
+                size_t i = head_->read;
+                for (; i < count && results.size() < limit; i++) {
+                    const Event& event = head_->events[i];
+                    ProfileResult& result = results.emplace_back();
+                    result.name = event.name;
+                    result.start = event.start;
+                    result.end = event.end;
+                    result.bytes = event.bytes;
+                    result.ThreadID = threadID_;
+#if PROFILE_PERF_COUNTERS
+                    memcpy(result.counters, event.counters, sizeof(event.counters));
+#endif
+                }
+                head_->read = i;
+                if (head_ == last || i < count) {
+                    break;
+                }
+                Chunk* next = head_->next.load(std::memory_order_acquire);
+                give_back_(head_);
+                head_ = next;
+            }
+        }
+
+        // The chunks record() had to allocate because none was free
+        u64 allocated_chunks() const {
+            return allocatedChunks_.load(std::memory_order_relaxed);
+        }
+
+        // Owning thread, as it exits: nothing takes the free chunks any more
+        void owner_exited() {
+            ownerExited_.store(true, std::memory_order_relaxed);
+            chunkCount_ -= delete_chunks_(spare_);
+            spare_ = nullptr;
+            chunkCount_ -= delete_chunks_(freed_.exchange(nullptr, std::memory_order_acquire));
+        }
+
+    private:
+        struct Event {
+            const char* name;
+            u64 start, end;
+            u64 bytes;
+#if PROFILE_PERF_COUNTERS
+            u64 counters[PROFILE_COUNTER_COUNT];
+#endif
+        };
+
+        // next also links the chunks of the free lists
+        struct Chunk {
+            Event events[CHUNK_SIZE];
+            std::atomic<size_t> count{0};
+            std::atomic<Chunk*> next{nullptr};
+            size_t read = 0;
+        };
+
+        // Owning thread only
+        Chunk* take_chunk_() {
+            if (!spare_) {
+                spare_ = freed_.exchange(nullptr, std::memory_order_acquire);
+            }
+            if (!spare_) {
+                allocatedChunks_.store(allocatedChunks_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                chunkCount_++;
+                return new Chunk;
+            }
+            Chunk* chunk = spare_;
+            spare_ = chunk->next.load(std::memory_order_relaxed);
+            chunk->next.store(nullptr, std::memory_order_relaxed);
+            return chunk;
+        }
+
+        // Flushing thread only, once the writer has moved past the chunk. Past PROFILE_PREALLOCATED_CHUNKS
+        // the chunks a burst needed are freed, or a buffer would keep the most it ever held.
+        void give_back_(Chunk* chunk) {
+            if (ownerExited_.load(std::memory_order_relaxed) || chunkCount_ > PROFILE_PREALLOCATED_CHUNKS) {
+                chunkCount_--;
+                delete chunk;
+                return;
+            }
+            chunk->count.store(0, std::memory_order_relaxed);
+            chunk->read = 0;
+            Chunk* top = freed_.load(std::memory_order_relaxed);
+            do {
+                chunk->next.store(top, std::memory_order_relaxed);
+            } while (!freed_.compare_exchange_weak(top, chunk, std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        static int delete_chunks_(Chunk* chunk) {
+            int count = 0;
+            while (chunk) {
+                Chunk* next = chunk->next.load(std::memory_order_acquire);
+                delete chunk;
+                chunk = next;
+                count++;
+            }
+            return count;
+        }
+
+        u32 threadID_;
+        Chunk* head_;  // flushing thread
+        Chunk* tail_;  // owning thread
+        Chunk* spare_ = nullptr;  // owning thread
+        std::atomic<Chunk*> freed_{nullptr};  // pushed by the flushing thread, taken whole by the owning thread
+        std::atomic<u64> allocatedChunks_{0};
+        std::atomic<int> chunkCount_{1};  // allocated and not deleted yet, head_ included
+        std::atomic<bool> ownerExited_{false};
 };
 
 /**
  * A session to manage the collection of profiling results.
- * Its destructor will write all collected results to a file.
+ * Its destructor will write all collected results to a file, with the CPU timer ticks converted to
+ * microseconds since the session started. The CPU timer frequency is calibrated once, against the
+ * OS timer over the whole session (or EstimateCPUTimerFreq() if the session was too short for that).
  * 
  * @param name The name of the session.
  * @param filePath The file path to write the results to.
  */
 class ProfilerSession {
     public:
-        ProfilerSession(const string& name, const string& filePath = "profile_results.json") :
-            name_(name),
-            filePath_(filePath) {}
-    
-        ~ProfilerSession() {
-            write_profile_results_();
-        }
+        ProfilerSession(const string& name, const string& filePath = "profile_results.json");
+        ~ProfilerSession();
 
     private:
         void write_profile_results_();
+        f64 cpu_timer_freq_() const;
         string name_;
         string filePath_;
+        u64 startTicks_;
+        u64 startOSTime_;
+        std::unique_ptr<class ProfileTraceWriter> traceWriter_;
 };
 
 /**
  * Singleton profiler class.
- * It collects and stores the profiling results in a thread safe way.
+ * Each thread records into its own ProfileThreadBuffer, the mutex is only taken when a thread
+ * records for the first time (to register its buffer) and when the buffers are merged.
  */
 class Profiler {
     public:
@@ -71,18 +408,120 @@ class Profiler {
             return instance;
         }
         
-        void add_result(const ProfileResult& result) {
+        void add_result(const char* name, u64 start, u64 end, u64 bytes = 0, const u64* counters = nullptr) {
+            thread_local ProfileThreadBuffer* buffer = nullptr;
+            if (!buffer) {
+                buffer = register_thread_();
+            }
+            buffer->record(name, start, end, bytes, counters);
+        }
+
+        /**
+         * The hardware events threads count from now on (PROFILE_PERF_COUNTERS), as ProfileCounter bits.
+         * A thread opens its counters the first time it enters a scope, so set them before that.
+         */
+        void set_perf_counters(u32 counters) {
+            perfCounters_.store(counters & PROFILE_ALL_COUNTERS, std::memory_order_relaxed);
+        }
+
+        u32 perf_counters() const {
+            return perfCounters_.load(std::memory_order_relaxed);
+        }
+
+        // The counters some thread could open, as ProfileCounter bits
+        u32 available_perf_counters() const {
+            return availablePerfCounters_.load(std::memory_order_relaxed);
+        }
+
+        // Why the first counter that could not be opened could not, empty if they all could
+        string perf_counter_error() {
+            lock_guard<mutex> lock(mutex_);
+            return perfCounterError_;
+        }
+
+        // Called by every thread that opens its counters
+        void report_perf_counters(u32 available, const string& error) {
+            availablePerfCounters_.fetch_or(available, std::memory_order_relaxed);
+            lock_guard<mutex> lock(mutex_);
+            if (perfCounterError_.empty() && !error.empty()) {
+                perfCounterError_ = error;
+            }
+        }
+
+        ProfileZoneTable& zone_table() {
+            thread_local ProfileZoneTable* table = nullptr;
+            if (!table) {
+                lock_guard<mutex> lock(mutex_);
+                zoneTables_.push_back(std::make_unique<ProfileZoneTable>());
+                table = zoneTables_.back().get();
+            }
+            return *table;
+        }
+
+        /**
+         * The zone slot for a name, the same for every site using that name.
+         * Called once per site (its result is kept in a static), so the slots do not depend on the
+         * order or the number of translation units. Returns 0 once PROFILE_MAX_ZONES names are taken.
+         */
+        u32 zone_slot(const char* name) {
             lock_guard<mutex> lock(mutex_);
-            results_.push_back(result);
+            for (u32 slot = 1; slot < zoneNames_.size(); slot++) {
+                if (strcmp(zoneNames_[slot], name) == 0) {
+                    return slot;
+                }
+            }
+            if (zoneNames_.size() == PROFILE_MAX_ZONES) {
+                droppedZones_++;
+                return 0;
+            }
+            zoneNames_.push_back(name);
+            return static_cast<u32>(zoneNames_.size() - 1);
+        }
+
+        /**
+         * Prints the zones of every thread added up, in the order they were first entered.
+         * 
+         * @param totalTicks The ticks the percentages are relative to.
+         * @param cpuTimerFreq CPU timer ticks per second.
+         */
+        void print_zones(u64 totalTicks, f64 cpuTimerFreq);
+
+        /**
+         * Merges the results recorded since the last call by every thread, ordered by start time.
+         * Threads can keep recording meanwhile, their newer results are left for the next call.
+         */
+        vector<ProfileResult> collect() {
+            vector<ProfileResult> results;
+            drain(results);
+            std::stable_sort(results.begin(), results.end(), [](const ProfileResult& a, const ProfileResult& b) {
+                return a.start < b.start;
+            });
+            return results;
         }
 
-        const vector<ProfileResult>& get_results() const {
-            return results_;
+        /**
+         * Appends the results recorded since the last call by every thread, thread by thread,
+         * until results holds limit of them (the rest is left for the next call).
+         */
+        void drain(vector<ProfileResult>& results, size_t limit = SIZE_MAX) {
+            lock_guard<mutex> lock(mutex_);
+            for (auto& buffer : buffers_) {
+                buffer->drain(results, limit);
+            }
         }
 
         void clear() {
+            collect();
+        }
+
+        // The event chunks threads had to allocate while recording, past PROFILE_PREALLOCATED_CHUNKS
+        u64 allocated_chunks() {
             lock_guard<mutex> lock(mutex_);
-            results_.clear();
+            u64 total = 0;
+            for (auto& buffer : buffers_) {
+                total += buffer->allocated_chunks();
+            }
+            return total;
         }
     
     private:
@@ -92,18 +531,349 @@ class Profiler {
         Profiler(const Profiler&) = delete;
         Profiler& operator=(const Profiler&) = delete;
 
+        ProfileThreadBuffer* register_thread_() {
+            u32 threadID = static_cast<u32>(hash<thread::id>{}(std::this_thread::get_id()));
+            lock_guard<mutex> lock(mutex_);
+            // Owned here, so the results of threads that have exited are still merged
+            buffers_.push_back(std::make_unique<ProfileThreadBuffer>(threadID));
+            // Only the chunks still holding results outlive the thread
+            struct ExitHook {
+                ProfileThreadBuffer* buffer;
+                ~ExitHook() { buffer->owner_exited(); }
+            };
+            thread_local ExitHook hook{buffers_.back().get()};
+            return buffers_.back().get();
+        }
+
         mutex mutex_;
-        vector<ProfileResult> results_;
+        vector<std::unique_ptr<ProfileThreadBuffer>> buffers_;
+        vector<std::unique_ptr<ProfileZoneTable>> zoneTables_;
+        vector<const char*> zoneNames_{""};  // by slot
+        u32 droppedZones_ = 0;
+        std::atomic<u32> perfCounters_{PROFILE_ALL_COUNTERS};
+        std::atomic<u32> availablePerfCounters_{0};
+        string perfCounterError_;
 };
 
+#if PROFILE_PERF_COUNTERS
+/**
+ * The perf_event_open counters of one thread, in one group so they are read (and scheduled)
+ * together. The kernel multiplexes groups when there are more events than hardware counters, so a
+ * scope's counts are scaled by the time the group was enabled over the time it actually ran during
+ * that scope (scope_values), not over the whole life of the counters.
+ * Only user space is counted, which perf_event_paranoid 2 still allows.
+ * 
+ * @param counters The events to open, as ProfileCounter bits.
+ */
+class ProfilePerfCounters {
+    public:
+        explicit ProfilePerfCounters(u32 counters) {
+            static const u32 types[PROFILE_COUNTER_COUNT] = {
+                PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_SOFTWARE
+            };
+            static const u64 configs[PROFILE_COUNTER_COUNT] = {
+                PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+                PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_SW_PAGE_FAULTS
+            };
+            string error;
+            for (u32 counter = 0; counter < PROFILE_COUNTER_COUNT; counter++) {
+                if (!(counters & (1u << counter))) {
+                    continue;
+                }
+                perf_event_attr attr;
+                memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = types[counter];
+                attr.config = configs[counter];
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader_, 0));
+                if (fd < 0) {
+                    if (error.empty()) {
+                        error = string(profile_counter_name(counter)) + ": " + strerror(errno);
+                        if (errno == EACCES || errno == EPERM) {
+                            error += " (see /proc/sys/kernel/perf_event_paranoid)";
+                        }
+                    }
+                    continue;
+                }
+                if (leader_ < 0) {
+                    leader_ = fd;
+                }
+                fds_[groupSize_] = fd;
+                order_[groupSize_++] = counter;
+                available_ |= 1u << counter;
+            }
+            Profiler::get().report_perf_counters(available_, error);
+        }
+
+        ~ProfilePerfCounters() {
+            for (u32 i = 0; i < groupSize_; i++) {
+                close(fds_[i]);
+            }
+        }
+
+        ProfilePerfCounters(const ProfilePerfCounters&) = delete;
+        ProfilePerfCounters& operator=(const ProfilePerfCounters&) = delete;
+
+        // The counters of the calling thread, opened the first time
+        static ProfilePerfCounters& current() {
+            thread_local ProfilePerfCounters counters(Profiler::get().perf_counters());
+            return counters;
+        }
+
+        // Unscaled counts since the counters were opened, with the time the group was enabled and running
+        struct Reading {
+            u64 enabled;
+            u64 running;
+            u64 values[PROFILE_COUNTER_COUNT];  // by ProfileCounter, 0 for the ones not available
+        };
+
+        void read_values(Reading& reading) const {
+            memset(&reading, 0, sizeof(reading));
+            if (leader_ < 0) {
+                return;
+            }
+            // nr, time enabled, time running, then the values in the order they were opened
+            u64 data[3 + PROFILE_COUNTER_COUNT];
+            if (read(leader_, data, sizeof(data)) < static_cast<ssize_t>((3 + groupSize_) * sizeof(u64))) {
+                return;
+            }
+            reading.enabled = data[1];
+            reading.running = data[2];
+            for (u32 i = 0; i < groupSize_; i++) {
+                reading.values[order_[i]] = data[3 + i];
+            }
+        }
+
+        /**
+         * The events between two readings, scaled by the time the group was enabled over the time it
+         * ran in between. All 0 if it did not run at all, there is nothing to scale then.
+         */
+        static void scope_values(const Reading& start, const Reading& end, u64 values[PROFILE_COUNTER_COUNT]) {
+            u64 enabled = end.enabled - start.enabled;
+            u64 running = end.running - start.running;
+            for (u32 counter = 0; counter < PROFILE_COUNTER_COUNT; counter++) {
+                u64 raw = end.values[counter] - start.values[counter];
+                if (running == 0) {
+                    values[counter] = 0;
+                } else if (enabled == running) {
+                    values[counter] = raw;
+                } else {
+                    values[counter] = static_cast<u64>(static_cast<f64>(raw) * static_cast<f64>(enabled) / static_cast<f64>(running));
+                }
+            }
+        }
+
+    private:
+        int leader_ = -1;
+        int fds_[PROFILE_COUNTER_COUNT];
+        u32 order_[PROFILE_COUNTER_COUNT];  // the ProfileCounter of each group member
+        u32 groupSize_ = 0;
+        u32 available_ = 0;
+};
+#endif
+
+#if PROFILE_SAMPLING
+struct ProfileSample {
+    const char* zone;  // the innermost PROFILE_SCOPE, nullptr outside of them
+    u32 depth;
+    void* frames[PROFILE_SAMPLE_DEPTH];  // the interrupted instruction, then the return addresses
+};
+
+/**
+ * Samples the call stack of whichever thread is running on SIGPROF, which setitimer(ITIMER_PROF)
+ * sends PROFILE_SAMPLE_HZ times per second of CPU time the process uses.
+ * The signal handler only copies the stack and the zone of the thread into a buffer of
+ * PROFILE_MAX_SAMPLES samples allocated up front, nothing is symbolized until sampling stops.
+ * The stack is walked through the saved frame pointers (async signal safe, unlike backtrace(),
+ * which can deadlock in the unwinder when the signal lands in a throw), reading only between the
+ * interrupted stack pointer and the top of the thread's stack. A thread records the top of its
+ * stack when it first enters a zone (or starts the sampler), the samples of other threads only
+ * hold the interrupted instruction.
+ */
+class ProfileSampler {
+    public:
+        static ProfileSampler& get() {
+            static ProfileSampler instance;
+            return instance;
+        }
+
+        // The innermost PROFILE_SCOPE the calling thread is in, set by the timers
+        static const char* volatile& active_zone() {
+            thread_local const char* volatile zone = nullptr;
+            return zone;
+        }
+
+        // Records the top of the calling thread's stack, for the stack walk of its samples
+        static void register_thread() {
+            if (stack_top_() == 0) {
+                register_thread_slow_();
+            }
+        }
+
+        void start() {
+            if (!samples_) {
+                samples_.reset(new ProfileSample[PROFILE_MAX_SAMPLES]);
+            }
+            register_thread();
+            next_ = 0;
+            active_ = true;
+            cpuSeconds_ = process_cpu_seconds_();
+
+            struct sigaction action;
+            memset(&action, 0, sizeof(action));
+            action.sa_sigaction = handle_signal_;
+            action.sa_flags = SA_SIGINFO | SA_RESTART;
+            sigemptyset(&action.sa_mask);
+            if (sigaction(SIGPROF, &action, &oldAction_) != 0) {
+                std::cerr << "Cannot handle SIGPROF, no call stacks will be sampled: " << strerror(errno) << std::endl;
+                // What stop() puts back
+                sigaction(SIGPROF, nullptr, &oldAction_);
+                return;
+            }
+
+            // tv_usec has to stay below a second, so PROFILE_SAMPLE_HZ 1 is tv_sec 1
+            long interval = std::max(1000000L / PROFILE_SAMPLE_HZ, 1L);
+            itimerval timer;
+            timer.it_interval.tv_sec = interval / 1000000;
+            timer.it_interval.tv_usec = interval % 1000000;
+            timer.it_value = timer.it_interval;
+            if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+                std::cerr << "Cannot start the sampling timer, no call stacks will be sampled: " << strerror(errno) << std::endl;
+            }
+        }
+
+        void stop() {
+            itimerval timer;
+            memset(&timer, 0, sizeof(timer));
+            setitimer(ITIMER_PROF, &timer, nullptr);
+            active_ = false;
+            cpuSeconds_ = process_cpu_seconds_() - cpuSeconds_;
+            // Drops a signal still pending, then waits for the handlers already running in other threads
+            signal(SIGPROF, SIG_IGN);
+            while (inHandler_ != 0) {
+                std::this_thread::yield();
+            }
+            sigaction(SIGPROF, &oldAction_, nullptr);
+        }
+
+        size_t sample_count() const {
+            return std::min<size_t>(next_, PROFILE_MAX_SAMPLES);
+        }
+
+        size_t dropped_count() const {
+            return next_ - sample_count();
+        }
+
+        /**
+         * Writes the samples taken between start() and stop() as folded stacks (the frames from the
+         * outermost one, separated by ';', then the number of samples), with the zone as the first
+         * frame, and prints the functions the most samples were taken in.
+         */
+        void write_folded(const string& filePath) const;
+
+    private:
+        ProfileSampler() = default;
+
+        ProfileSampler(const ProfileSampler&) = delete;
+        ProfileSampler& operator=(const ProfileSampler&) = delete;
+
+        static volatile uintptr_t& stack_top_() {
+            thread_local volatile uintptr_t top = 0;
+            return top;
+        }
+
+        __attribute__((noinline)) static void register_thread_slow_() {
+            pthread_attr_t attributes;
+            if (pthread_getattr_np(pthread_self(), &attributes) != 0) {
+                return;
+            }
+            void* bottom = nullptr;
+            size_t size = 0;
+            if (pthread_attr_getstack(&attributes, &bottom, &size) == 0) {
+                stack_top_() = reinterpret_cast<uintptr_t>(bottom) + size;
+            }
+            pthread_attr_destroy(&attributes);
+        }
+
+        static f64 process_cpu_seconds_() {
+            timespec time;
+            clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+            return static_cast<f64>(time.tv_sec) + static_cast<f64>(time.tv_nsec) / 1e9;
+        }
+
+        static void handle_signal_(int, siginfo_t*, void* context) {
+            ProfileSampler& sampler = get();
+            int savedErrno = errno;
+            sampler.inHandler_++;
+            if (sampler.active_) {
+                size_t index = sampler.next_++;
+                if (index < PROFILE_MAX_SAMPLES) {
+                    sampler.take_sample_(sampler.samples_[index], static_cast<ucontext_t*>(context));
+                }
+            }
+            sampler.inHandler_--;
+            errno = savedErrno;
+        }
+
+        void take_sample_(ProfileSample& sample, const ucontext_t* context) {
+            const greg_t* registers = context->uc_mcontext.gregs;
+            sample.frames[0] = reinterpret_cast<void*>(registers[REG_RIP]);
+            u32 depth = 1;
+
+            // Each frame starts with the caller's frame pointer, then the return address. The chain
+            // only goes up the stack, and anything outside of it (rbp used as a plain register by
+            // code without frame pointers, a thread not registered) ends the walk.
+            uintptr_t low = static_cast<uintptr_t>(registers[REG_RSP]);
+            uintptr_t high = stack_top_();
+            uintptr_t frame = static_cast<uintptr_t>(registers[REG_RBP]);
+            while (depth < PROFILE_SAMPLE_DEPTH && frame >= low && frame + 2 * sizeof(uintptr_t) <= high &&
+                   frame % sizeof(uintptr_t) == 0) {
+                const uintptr_t* words = reinterpret_cast<const uintptr_t*>(frame);
+                if (words[1] == 0) {
+                    break;
+                }
+                sample.frames[depth++] = reinterpret_cast<void*>(words[1]);
+                if (words[0] <= frame) {
+                    break;
+                }
+                frame = words[0];
+            }
+            sample.zone = active_zone();
+            sample.depth = depth;
+        }
+
+        std::unique_ptr<ProfileSample[]> samples_;
+        std::atomic<size_t> next_{0};
+        std::atomic<bool> active_{false};
+        std::atomic<u32> inHandler_{0};
+        struct sigaction oldAction_;
+        f64 cpuSeconds_ = 0;  // the CPU time of the process between start() and stop()
+};
+#endif
+
 /**
  * Timer class that uses RAII to automatically record the start and end times of a scope.
+ * 
+ * @param name The name of the scope, a static string.
+ * @param bytes The bytes the scope processes, for its bandwidth (0 if it does not apply).
  */
 class InstrumentationTimer {
     public:
-        InstrumentationTimer(const string& name): 
-            name_(name), stopped_(false) {
-                StartTimePoint_ = Clock::now();
+        InstrumentationTimer(const char* name, u64 bytes = 0): 
+            name_(name), bytes_(bytes), stopped_(false) {
+#if PROFILE_PERF_COUNTERS
+                // Outside the timed part, the system call is not the scope's
+                ProfilePerfCounters::current().read_values(startCounters_);
+#endif
+#if PROFILE_SAMPLING
+                ProfileSampler::register_thread();
+                outerZone_ = ProfileSampler::active_zone();
+                ProfileSampler::active_zone() = name_;
+#endif
+                startTicks_ = read_profile_timer();
             }
         
         ~InstrumentationTimer() {
@@ -112,23 +882,115 @@ class InstrumentationTimer {
             }
         }
         void stop() {
-            auto endTimePoint = Clock::now();
-            ll start = std::chrono::time_point_cast<std::chrono::microseconds>(StartTimePoint_).time_since_epoch().count();
-            ll end = std::chrono::time_point_cast<std::chrono::microseconds>(endTimePoint).time_since_epoch().count();
-            // Thread ID (this identifies the thread that the scope was in)
-            u32 threadID = static_cast<u32>(hash<thread::id>{}(std::this_thread::get_id()));
-            
-            Profiler::get().add_result({name_, start, end, threadID});
+            u64 endTicks = read_profile_timer();
+#if PROFILE_PERF_COUNTERS
+            ProfilePerfCounters::Reading endCounters;
+            ProfilePerfCounters::current().read_values(endCounters);
+            u64 counters[PROFILE_COUNTER_COUNT];
+            ProfilePerfCounters::scope_values(startCounters_, endCounters, counters);
+            Profiler::get().add_result(name_, startTicks_, endTicks, bytes_, counters);
+#else
+            Profiler::get().add_result(name_, startTicks_, endTicks, bytes_);
+#endif
+#if PROFILE_SAMPLING
+            ProfileSampler::active_zone() = outerZone_;
+#endif
             stopped_ = true;
         }
 
     private:
-        const string name_;
-        TimePoint StartTimePoint_;
+        const char* name_;
+        u64 bytes_;
+        u64 startTicks_;
         bool stopped_;
+#if PROFILE_PERF_COUNTERS
+        ProfilePerfCounters::Reading startCounters_;
+#endif
+#if PROFILE_SAMPLING
+        const char* outerZone_;
+#endif
+};
+
+/**
+ * Adds the time until its destruction to a zone, in the PROFILING_ZONES mode.
+ * The zone open in the thread when it starts is its parent: the time is subtracted from the
+ * parent's exclusive time. A zone entered again while it is still open (recursion) keeps its
+ * inclusive time from the outermost entry only.
+ * 
+ * @param slot The zone slot, from Profiler::zone_slot().
+ * @param name The zone name, for the samples taken in it (PROFILE_SAMPLING).
+ * @param bytes The bytes this hit of the zone processes, for its bandwidth (0 if it does not apply).
+ */
+class ProfileZoneTimer {
+    public:
+        ProfileZoneTimer(u32 slot, const char* name, u64 bytes = 0):
+            table_(Profiler::get().zone_table()), slot_(slot), bytes_(bytes) {
+#if PROFILE_SAMPLING
+                ProfileSampler::register_thread();
+                outerZone_ = ProfileSampler::active_zone();
+                ProfileSampler::active_zone() = name;
+#else
+                (void)name;
+#endif
+                parent_ = table_.current;
+                table_.current = slot_;
+                oldInclusiveTicks_ = table_.zones[slot_].inclusiveTicks.load(std::memory_order_relaxed);
+#if PROFILE_PERF_COUNTERS
+                for (u32 counter = 0; counter < PROFILE_COUNTER_COUNT; counter++) {
+                    oldCounters_[counter] = table_.zones[slot_].counters[counter].load(std::memory_order_relaxed);
+                }
+                ProfilePerfCounters::current().read_values(startCounters_);
+#endif
+                startTicks_ = read_profile_timer();
+            }
+
+        ~ProfileZoneTimer() {
+            u64 elapsed = read_profile_timer() - startTicks_;
+            ProfileZoneTotals& zone = table_.zones[slot_];
+            table_.current = parent_;
+#if PROFILE_PERF_COUNTERS
+            ProfilePerfCounters::Reading endCounters;
+            ProfilePerfCounters::current().read_values(endCounters);
+            u64 counters[PROFILE_COUNTER_COUNT];
+            ProfilePerfCounters::scope_values(startCounters_, endCounters, counters);
+            for (u32 counter = 0; counter < PROFILE_COUNTER_COUNT; counter++) {
+                zone.counters[counter].store(oldCounters_[counter] + counters[counter], std::memory_order_relaxed);
+            }
+#endif
+
+            // Wraps around in the parent until its own destructor adds its elapsed ticks
+            add_profile_total(table_.zones[parent_].exclusiveTicks, 0 - elapsed);
+            add_profile_total(zone.exclusiveTicks, elapsed);
+            // Inner recursive entries stored their own totals, the outermost one overwrites them
+            zone.inclusiveTicks.store(oldInclusiveTicks_ + elapsed, std::memory_order_relaxed);
+            add_profile_total(zone.hitCount, 1);
+            add_profile_total(zone.byteCount, bytes_);
+#if PROFILE_SAMPLING
+            ProfileSampler::active_zone() = outerZone_;
+#endif
+        }
+
+        ProfileZoneTimer(const ProfileZoneTimer&) = delete;
+        ProfileZoneTimer& operator=(const ProfileZoneTimer&) = delete;
+
+    private:
+        ProfileZoneTable& table_;
+        u32 slot_;
+        u32 parent_;
+        u64 bytes_;
+        u64 oldInclusiveTicks_;
+        u64 startTicks_;
+#if PROFILE_PERF_COUNTERS
+        u64 oldCounters_[PROFILE_COUNTER_COUNT];
+        ProfilePerfCounters::Reading startCounters_;
+#endif
+#if PROFILE_SAMPLING
+        const char* outerZone_;
+#endif
 };
 
 // ============== MACROS ==============
+
 // These will be compiled away to nothing if PROFILING_ENABLED is not 1 for release builds
 #if PROFILING_ENABLED
     // Helper macros to concatenate tokens (for unique name creation)
@@ -138,29 +1000,331 @@ class InstrumentationTimer {
 
     // Main macros 
     #define PROFILE_SESSION(name, filePath) ProfilerSession session(name, filePath)
-    #define PROFILE_FUNCTION() InstrumentationTimer PROFILE_UNIQUE_NAME(timer)(__func__)
-    #define PROFILE_SCOPE(name) InstrumentationTimer PROFILE_UNIQUE_NAME(timer)(name)
+    #if PROFILING_ZONES
+        #define PROFILE_BANDWIDTH(name, bytes) \
+            static const u32 PROFILE_UNIQUE_NAME(zoneSlot) = Profiler::get().zone_slot(name); \
+            ProfileZoneTimer PROFILE_UNIQUE_NAME(zone)(PROFILE_UNIQUE_NAME(zoneSlot), name, bytes)
+    #else
+        #define PROFILE_BANDWIDTH(name, bytes) InstrumentationTimer PROFILE_UNIQUE_NAME(timer)(name, bytes)
+    #endif
+    #define PROFILE_FUNCTION() PROFILE_BANDWIDTH(__func__, 0)
+    #define PROFILE_SCOPE(name) PROFILE_BANDWIDTH(name, 0)
 #else 
     #define PROFILE_SESSION(name, filePath)
     #define PROFILE_FUNCTION()
     #define PROFILE_SCOPE(name)
+    // bytes is not evaluated either
+    #define PROFILE_BANDWIDTH(name, bytes)
 #endif
 
-inline void ProfilerSession::write_profile_results_() {
-    std::ofstream output_file(filePath_);
-    if (!output_file.is_open()) {
-        std::cerr << "Failed to open file for writing: " << filePath_ << std::endl;
-        return;
+inline void Profiler::print_zones(u64 totalTicks, f64 cpuTimerFreq) {
+    lock_guard<mutex> lock(mutex_);
+    f64 millisecondsPerTick = 1e3 / cpuTimerFreq;
+    f64 percentPerTick = totalTicks ? 100.0 / static_cast<f64>(totalTicks) : 0.0;
+
+    size_t nameWidth = 4;
+    for (const char* name : zoneNames_) {
+        nameWidth = std::max(nameWidth, strlen(name));
+    }
+
+    // The hardware event counters (PROFILE_PERF_COUNTERS) some thread could open, inclusive like the bandwidth
+    u32 counters = availablePerfCounters_.load(std::memory_order_relaxed);
+    u32 ipcCounters = (1u << PROFILE_CYCLES) | (1u << PROFILE_INSTRUCTIONS);
+    bool showIPC = (counters & ipcCounters) == ipcCounters;
+
+    char line[512];
+    snprintf(line, sizeof(line), "  %-*s %12s %14s %7s %14s %7s %12s", static_cast<int>(nameWidth), "Zone",
+             "Hits", "Exclusive ms", "%", "Inclusive ms", "%", "Bandwidth");
+    std::cout << line;
+    if (showIPC) {
+        std::cout << "    IPC";
     }
+    for (u32 counter = 0; counter < PROFILE_COUNTER_COUNT; counter++) {
+        if (counters & (1u << counter)) {
+            snprintf(line, sizeof(line), " %15s", profile_counter_name(counter));
+            std::cout << line;
+        }
+    }
+    std::cout << std::endl;
+    for (u32 slot = 1; slot < zoneNames_.size(); slot++) {
+        u64 hitCount = 0, inclusiveTicks = 0, exclusiveTicks = 0, byteCount = 0;
+        u64 counterTotals[PROFILE_COUNTER_COUNT] = {};
+        for (auto& table : zoneTables_) {
+            const ProfileZoneTotals& zone = table->zones[slot];
+            hitCount += zone.hitCount.load(std::memory_order_relaxed);
+            inclusiveTicks += zone.inclusiveTicks.load(std::memory_order_relaxed);
+            exclusiveTicks += zone.exclusiveTicks.load(std::memory_order_relaxed);
+            byteCount += zone.byteCount.load(std::memory_order_relaxed);
+#if PROFILE_PERF_COUNTERS
+            for (u32 counter = 0; counter < PROFILE_COUNTER_COUNT; counter++) {
+                counterTotals[counter] += zone.counters[counter].load(std::memory_order_relaxed);
+            }
+#endif
+        }
+
+        // Over the inclusive time: the bytes go through the zone's children too
+        char bandwidth[32] = "";
+        if (byteCount && inclusiveTicks) {
+            f64 bytesPerSecond = static_cast<f64>(byteCount) * cpuTimerFreq / static_cast<f64>(inclusiveTicks);
+            if (bytesPerSecond >= 1024.0 * 1024.0 * 1024.0) {
+                snprintf(bandwidth, sizeof(bandwidth), "%.2f GB/s", bytesPerSecond / (1024.0 * 1024.0 * 1024.0));
+            } else {
+                snprintf(bandwidth, sizeof(bandwidth), "%.2f MB/s", bytesPerSecond / (1024.0 * 1024.0));
+            }
+        }
+        snprintf(line, sizeof(line), "  %-*s %12llu %14.3f %6.2f%% %14.3f %6.2f%% %12s", static_cast<int>(nameWidth),
+                 zoneNames_[slot], static_cast<unsigned long long>(hitCount),
+                 static_cast<f64>(exclusiveTicks) * millisecondsPerTick, static_cast<f64>(exclusiveTicks) * percentPerTick,
+                 static_cast<f64>(inclusiveTicks) * millisecondsPerTick, static_cast<f64>(inclusiveTicks) * percentPerTick,
+                 bandwidth);
+        std::cout << line;
+        if (showIPC) {
+            f64 ipc = counterTotals[PROFILE_CYCLES] ? static_cast<f64>(counterTotals[PROFILE_INSTRUCTIONS]) / static_cast<f64>(counterTotals[PROFILE_CYCLES]) : 0.0;
+            snprintf(line, sizeof(line), " %6.2f", ipc);
+            std::cout << line;
+        }
+        for (u32 counter = 0; counter < PROFILE_COUNTER_COUNT; counter++) {
+            if (counters & (1u << counter)) {
+                snprintf(line, sizeof(line), " %15llu", static_cast<unsigned long long>(counterTotals[counter]));
+                std::cout << line;
+            }
+        }
+        std::cout << std::endl;
+    }
+    snprintf(line, sizeof(line), "  Total %.3f ms (CPU timer %.3f GHz)", static_cast<f64>(totalTicks) * millisecondsPerTick,
+             cpuTimerFreq / 1e9);
+    std::cout << line << std::endl;
+    if (droppedZones_) {
+        std::cout << "  " << droppedZones_ << " zone sites left out, raise PROFILE_MAX_ZONES" << std::endl;
+    }
+    if (PROFILE_PERF_COUNTERS && !perfCounterError_.empty()) {
+        std::cout << "  Some hardware event counters could not be opened, " << perfCounterError_ << std::endl;
+    }
+}
+
+// ============== BINARY TRACE ==============
+/**
+ * A binary trace (PROFILE_STREAM_TRACE) is a ProfileTraceHeader followed by records of
+ * header.recordSize bytes: a ProfileTraceRecord, then with PROFILE_PERF_COUNTERS one u64 per
+ * ProfileCounter (the event's counters, zeros in other records).
+ * - name records (tag PROFILE_TRACE_NAME) give a name its index, and are followed by the name
+ *   itself, padded with zeros to whole records. Name 0 is the session's name.
+ * - event records have the index of their name as tag, and come before the end record in no
+ *   particular order.
+ * - the end record (tag PROFILE_TRACE_END), written when the session ends, gives the session's
+ *   end ticks, the CPU timer frequency and the counters that were available. A trace without one
+ *   was cut short.
+ * 
+ * @param tag The name index of an event, or PROFILE_TRACE_NAME / PROFILE_TRACE_END.
+ * @param threadID The thread ID of an event, the name index of a name record, the available counters (ProfileCounter bits) of the end record.
+ * @param start The start ticks of an event, the name length of a name record, the end ticks of the end record.
+ * @param end The end ticks of an event.
+ * @param bytes The bytes of an event, the bits of the f64 CPU timer frequency of the end record.
+ */
+struct ProfileTraceRecord {
+    u32 tag;
+    u32 threadID;
+    u64 start;
+    u64 end;
+    u64 bytes;
+};
+
+struct ProfileTraceHeader {
+    char magic[8];
+    u32 version;
+    u32 recordSize;
+    u64 startTicks;
+    u64 timestamp;  // time() at the start of the session
+};
+
+static_assert(sizeof(ProfileTraceRecord) == 32 && sizeof(ProfileTraceHeader) == 32, "trace layout");
+constexpr char PROFILE_TRACE_MAGIC[8] = {'P', 'R', 'O', 'F', 'T', 'R', 'C', 0};
+constexpr u32 PROFILE_TRACE_VERSION = 1;
+constexpr u32 PROFILE_TRACE_NAME = 0xFFFFFFFF;
+constexpr u32 PROFILE_TRACE_END = 0xFFFFFFFE;
+constexpr u32 PROFILE_TRACE_COUNTERS = PROFILE_PERF_COUNTERS ? static_cast<u32>(PROFILE_COUNTER_COUNT) : 0;
+constexpr u32 PROFILE_TRACE_RECORD_SIZE = sizeof(ProfileTraceRecord) + PROFILE_TRACE_COUNTERS * sizeof(u64);
+
+/**
+ * Writes the events of a session to a binary trace as they are recorded.
+ * A background thread drains the thread buffers every PROFILE_STREAM_INTERVAL_MS and appends them,
+ * so memory stays bounded and only the last interval is left to write when the session ends.
+ * 
+ * @param path The file path to write the trace to.
+ * @param sessionName The name of the session.
+ * @param startTicks The ticks the session started at.
+ */
+class ProfileTraceWriter {
+    public:
+        ProfileTraceWriter(const string& path, const string& sessionName, u64 startTicks):
+            file_(fopen(path.c_str(), "wb")) {
+                if (!file_) {
+                    std::cerr << "Failed to open file for writing: " << path << std::endl;
+                } else {
+                    setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+                    ProfileTraceHeader header = {};
+                    memcpy(header.magic, PROFILE_TRACE_MAGIC, sizeof(header.magic));
+                    header.version = PROFILE_TRACE_VERSION;
+                    header.recordSize = PROFILE_TRACE_RECORD_SIZE;
+                    header.startTicks = startTicks;
+                    header.timestamp = static_cast<u64>(std::time(nullptr));
+                    fwrite(&header, sizeof(header), 1, file_);
+                    write_name_(0, sessionName.c_str(), sessionName.size());
+                }
+                thread_ = thread([this] { run_(); });
+            }
+
+        ~ProfileTraceWriter() {
+            if (thread_.joinable()) {
+                stop_();
+            }
+            if (file_) {
+                fclose(file_);
+            }
+        }
+
+        ProfileTraceWriter(const ProfileTraceWriter&) = delete;
+        ProfileTraceWriter& operator=(const ProfileTraceWriter&) = delete;
+
+        // Writes what is left and the end record, and closes the trace
+        void finish(u64 endTicks, f64 cpuTimerFreq) {
+            stop_();
+            if (file_) {
+                ProfileTraceRecord record = {PROFILE_TRACE_END, Profiler::get().available_perf_counters(), endTicks, 0, 0};
+                memcpy(&record.bytes, &cpuTimerFreq, sizeof(record.bytes));
+                records_.clear();
+                append_record_(record, nullptr);
+                fwrite(records_.data(), 1, records_.size(), file_);
+                fclose(file_);
+                file_ = nullptr;
+            }
+        }
+
+    private:
+        void run_() {
+            std::unique_lock<mutex> lock(mutex_);
+            while (!stopping_) {
+                wake_.wait_for(lock, std::chrono::milliseconds(PROFILE_STREAM_INTERVAL_MS));
+                lock.unlock();
+                flush_();
+                lock.lock();
+            }
+        }
+
+        void stop_() {
+            {
+                lock_guard<mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            wake_.notify_one();
+            thread_.join();
+            // Anything recorded after the thread's last flush
+            flush_();
+        }
+
+        // Drained even without a file, so the thread buffers do not keep growing
+        void flush_() {
+            do {
+                results_.clear();
+                Profiler::get().drain(results_, FLUSH_BATCH);
+                write_results_();
+            } while (results_.size() == FLUSH_BATCH);
+            if (file_) {
+                fflush(file_);
+            }
+        }
+
+        // In batches, so memory does not depend on how far behind the writer is
+        static constexpr size_t FLUSH_BATCH = 65536;
+
+        void write_results_() {
+            if (!file_) {
+                return;
+            }
+            records_.clear();
+            const char* lastName = nullptr;
+            u32 nameIndex = 0;
+            for (const ProfileResult& result : results_) {
+                if (result.name == lastName) {
+                    // Same as the last one, as it mostly is in a thread's run of results
+                } else if (auto found = nameIndices_.find(result.name); found != nameIndices_.end()) {
+                    nameIndex = found->second;
+                } else {
+                    nameIndex = static_cast<u32>(nameIndices_.size()) + 1;
+                    nameIndices_.emplace(result.name, nameIndex);
+                    fwrite(records_.data(), 1, records_.size(), file_);
+                    records_.clear();
+                    write_name_(nameIndex, result.name, strlen(result.name));
+                }
+                lastName = result.name;
+#if PROFILE_PERF_COUNTERS
+                append_record_({nameIndex, result.ThreadID, result.start, result.end, result.bytes}, result.counters);
+#else
+                append_record_({nameIndex, result.ThreadID, result.start, result.end, result.bytes}, nullptr);
+#endif
+            }
+            fwrite(records_.data(), 1, records_.size(), file_);
+        }
+
+        // counters can be null (zeros) for records that are not events
+        void append_record_(const ProfileTraceRecord& record, const u64* counters) {
+            const char* bytes = reinterpret_cast<const char*>(&record);
+            records_.insert(records_.end(), bytes, bytes + sizeof(record));
+            if (counters) {
+                bytes = reinterpret_cast<const char*>(counters);
+                records_.insert(records_.end(), bytes, bytes + PROFILE_TRACE_COUNTERS * sizeof(u64));
+            } else {
+                records_.resize(records_.size() + PROFILE_TRACE_COUNTERS * sizeof(u64), 0);
+            }
+        }
+
+        void write_name_(u32 index, const char* name, size_t length) {
+            records_.clear();
+            append_record_({PROFILE_TRACE_NAME, index, length, 0, 0}, nullptr);
+            records_.insert(records_.end(), name, name + length);
+            size_t remainder = length % PROFILE_TRACE_RECORD_SIZE;
+            if (remainder) {
+                records_.resize(records_.size() + PROFILE_TRACE_RECORD_SIZE - remainder, 0);
+            }
+            fwrite(records_.data(), 1, records_.size(), file_);
+            records_.clear();
+        }
+
+        FILE* file_;
+        thread thread_;
+        mutex mutex_;
+        std::condition_variable wake_;
+        bool stopping_ = false;
+        vector<ProfileResult> results_;           // reused from one flush to the next
+        vector<char> records_;                    // records ready to be written
+        std::unordered_map<const char*, u32> nameIndices_;  // by name pointer, names are static strings
+};
+
+/**
+ * Writes results as Chrome trace JSON (chrome://tracing, Perfetto), with the CPU timer ticks
+ * converted to microseconds since startTicks.
+ * 
+ * @param output_file The stream to write to.
+ * @param sessionName The name of the session.
+ * @param timestamp The time() the session was written (or started) at.
+ * @param results The results to write.
+ * @param startTicks The ticks the session started at.
+ * @param cpuTimerFreq CPU timer ticks per second.
+ * @param counters The hardware event counters to write (PROFILE_PERF_COUNTERS), as ProfileCounter bits.
+ */
+inline void write_chrome_trace(std::ostream& output_file, const string& sessionName, u64 timestamp,
+                               const vector<ProfileResult>& results, u64 startTicks, f64 cpuTimerFreq,
+                               u32 counters = 0) {
+    f64 microsecondsPerTick = 1e6 / cpuTimerFreq;
 
     output_file << "{\"otherData\": {";
-    output_file << "\"sessionName\":\"" << name_ << "\",";
-    output_file << "\"timestamp\":\"" << std::time(nullptr) << "\",";
+    output_file << "\"sessionName\":\"" << sessionName << "\",";
+    output_file << "\"timestamp\":\"" << timestamp << "\",";
     output_file << "\"version\":\"1.0\"";
     output_file << "},\"traceEvents\":[";
+    output_file << std::fixed << std::setprecision(3);
 
 
-    const auto& results = Profiler::get().get_results();
     for (size_t i = 0; i < results.size(); i++) {
         const auto& result = results[i];
 
@@ -173,17 +1337,299 @@ inline void ProfilerSession::write_profile_results_() {
 
         output_file << "{";
         output_file << "\"cat\":\"function\",";
-        output_file << "\"dur\":" << (result.end - result.start) << ',';
+        output_file << "\"dur\":" << static_cast<f64>(result.end - result.start) * microsecondsPerTick << ',';
         output_file << "\"name\":\"" << name << "\",";
         output_file << "\"ph\":\"X\",";
         output_file << "\"pid\":0,";
         output_file << "\"tid\":" << result.ThreadID << ",";
-        output_file << "\"ts\":" << result.start;
+        // Signed, results recorded before the session started come out negative
+        output_file << "\"ts\":" << static_cast<f64>(static_cast<int64_t>(result.start - startTicks)) * microsecondsPerTick;
+        const char* separator = ",\"args\":{";
+        if (result.bytes) {
+            f64 seconds = static_cast<f64>(result.end - result.start) * microsecondsPerTick / 1e6;
+            f64 megabytesPerSecond = seconds > 0 ? static_cast<f64>(result.bytes) / (1024.0 * 1024.0) / seconds : 0.0;
+            output_file << separator << "\"bytes\":" << result.bytes << ",\"MB/s\":" << megabytesPerSecond;
+            separator = ",";
+        }
+#if PROFILE_PERF_COUNTERS
+        for (u32 counter = 0; counter < PROFILE_COUNTER_COUNT; counter++) {
+            if (counters & (1u << counter)) {
+                output_file << separator << "\"" << profile_counter_name(counter) << "\":" << result.counters[counter];
+                separator = ",";
+            }
+        }
+        u32 ipcCounters = (1u << PROFILE_CYCLES) | (1u << PROFILE_INSTRUCTIONS);
+        if ((counters & ipcCounters) == ipcCounters && result.counters[PROFILE_CYCLES]) {
+            output_file << ",\"IPC\":" << static_cast<f64>(result.counters[PROFILE_INSTRUCTIONS]) / static_cast<f64>(result.counters[PROFILE_CYCLES]);
+        }
+#else
+        (void)counters;
+#endif
+        if (separator[0] == ',' && separator[1] == '\0') {
+            // Some args were written
+            output_file << "}";
+        }
         output_file << "}";
     }
 
     output_file << "]}";
+}
+
+// ============== SAMPLING ==============
+
+#if PROFILE_SAMPLING
+/**
+ * Names the functions of sampled addresses, with the symbol table (.symtab, or .dynsym when the
+ * file is stripped) of the executable or library each one is in, so static functions get a name
+ * as well. Addresses no symbol covers are named after dladdr(), or module+offset.
+ */
+class ProfileSymbolizer {
+    public:
+        ProfileSymbolizer() {
+            dl_iterate_phdr(add_module_, this);
+        }
+
+        const string& name(u64 address) {
+            auto found = names_.find(address);
+            if (found == names_.end()) {
+                found = names_.emplace(address, symbolize_(address)).first;
+            }
+            return found->second;
+        }
+
+    private:
+        struct Symbol {
+            u64 start, size;
+            string name;
+        };
+
+        struct Module {
+            string path;
+            u64 bias;  // where it is loaded, the symbols are relative to it
+            vector<std::pair<u64, u64>> segments;
+            bool loaded = false;
+            vector<Symbol> symbols;  // by start
+        };
+
+        static int add_module_(dl_phdr_info* info, size_t, void* data) {
+            Module module;
+            // The executable has no name here
+            module.path = (info->dlpi_name && info->dlpi_name[0]) ? info->dlpi_name : executable_path_();
+            module.bias = info->dlpi_addr;
+            for (int i = 0; i < info->dlpi_phnum; i++) {
+                if (info->dlpi_phdr[i].p_type == PT_LOAD) {
+                    u64 start = info->dlpi_addr + info->dlpi_phdr[i].p_vaddr;
+                    module.segments.emplace_back(start, start + info->dlpi_phdr[i].p_memsz);
+                }
+            }
+            static_cast<ProfileSymbolizer*>(data)->modules_.push_back(module);
+            return 0;
+        }
+
+        static string executable_path_() {
+            char path[4096];
+            ssize_t length = readlink("/proc/self/exe", path, sizeof(path));
+            return (length > 0 && length < static_cast<ssize_t>(sizeof(path))) ? string(path, length) : "/proc/self/exe";
+        }
+
+        static string demangle_(const char* name) {
+            int status = 0;
+            char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+            string result = (status == 0 && demangled) ? demangled : name;
+            free(demangled);
+            // ';' separates the frames of a folded stack
+            std::replace(result.begin(), result.end(), ';', ',');
+            return result;
+        }
+
+        void load_symbols_(Module& module) {
+            module.loaded = true;
+            std::ifstream file(module.path, std::ios::binary);
+            vector<char> elf((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            Elf64_Ehdr header;
+            if (elf.size() < sizeof(header)) {
+                return;
+            }
+            memcpy(&header, elf.data(), sizeof(header));
+            if (memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 || header.e_ident[EI_CLASS] != ELFCLASS64 ||
+                header.e_shentsize != sizeof(Elf64_Shdr) || header.e_shoff + header.e_shnum * sizeof(Elf64_Shdr) > elf.size()) {
+                return;
+            }
+            vector<Elf64_Shdr> sections(header.e_shnum);
+            memcpy(sections.data(), elf.data() + header.e_shoff, header.e_shnum * sizeof(Elf64_Shdr));
+            const Elf64_Shdr* table = nullptr;
+            for (const Elf64_Shdr& section : sections) {
+                if (section.sh_type == SHT_SYMTAB || (section.sh_type == SHT_DYNSYM && !table)) {
+                    table = &section;
+                }
+            }
+            if (!table || table->sh_link >= sections.size()) {
+                return;
+            }
+            const Elf64_Shdr& strings = sections[table->sh_link];
+            if (table->sh_offset + table->sh_size > elf.size() || strings.sh_offset + strings.sh_size > elf.size()) {
+                return;
+            }
+            for (u64 offset = 0; offset + sizeof(Elf64_Sym) <= table->sh_size; offset += sizeof(Elf64_Sym)) {
+                Elf64_Sym symbol;
+                memcpy(&symbol, elf.data() + table->sh_offset + offset, sizeof(symbol));
+                u32 type = ELF64_ST_TYPE(symbol.st_info);
+                if ((type != STT_FUNC && type != STT_GNU_IFUNC) || symbol.st_shndx == SHN_UNDEF ||
+                    symbol.st_value == 0 || symbol.st_name >= strings.sh_size) {
+                    continue;
+                }
+                const char* name = elf.data() + strings.sh_offset + symbol.st_name;
+                module.symbols.push_back({symbol.st_value, symbol.st_size, string(name, strnlen(name, strings.sh_size - symbol.st_name))});
+            }
+            std::sort(module.symbols.begin(), module.symbols.end(), [](const Symbol& a, const Symbol& b) {
+                return a.start < b.start;
+            });
+        }
+
+        string symbolize_(u64 address) {
+            for (Module& module : modules_) {
+                bool inside = false;
+                for (const auto& segment : module.segments) {
+                    inside = inside || (address >= segment.first && address < segment.second);
+                }
+                if (!inside) {
+                    continue;
+                }
+                if (!module.loaded) {
+                    load_symbols_(module);
+                }
+                u64 offset = address - module.bias;
+                auto next = std::upper_bound(module.symbols.begin(), module.symbols.end(), offset, [](u64 value, const Symbol& symbol) {
+                    return value < symbol.start;
+                });
+                if (next != module.symbols.begin() && offset < std::prev(next)->start + std::max<u64>(std::prev(next)->size, 1)) {
+                    return demangle_(std::prev(next)->name.c_str());
+                }
+                Dl_info info;
+                if (dladdr(reinterpret_cast<void*>(address), &info) && info.dli_sname) {
+                    return demangle_(info.dli_sname);
+                }
+                char name[64];
+                snprintf(name, sizeof(name), "+0x%llx", static_cast<unsigned long long>(offset));
+                return module.path.substr(module.path.find_last_of('/') + 1) + name;
+            }
+            char name[32];
+            snprintf(name, sizeof(name), "0x%llx", static_cast<unsigned long long>(address));
+            return name;
+        }
+
+        vector<Module> modules_;
+        std::unordered_map<u64, string> names_;
+};
+
+inline void ProfileSampler::write_folded(const string& filePath) const {
+    ProfileSymbolizer symbolizer;
+    std::map<string, u64> stacks;
+    std::unordered_map<string, u64> selfSamples;
+    for (size_t index = 0; index < sample_count(); index++) {
+        const ProfileSample& sample = samples_[index];
+        string stack = sample.zone ? string("[") + sample.zone + "]" : string();
+        for (u32 frame = sample.depth; frame-- > 0;) {
+            // A return address is past the call, its line can be the next one
+            u64 address = reinterpret_cast<u64>(sample.frames[frame]) - (frame > 0 ? 1 : 0);
+            const string& name = symbolizer.name(address);
+            stack += stack.empty() ? name : ";" + name;
+            if (frame == 0) {
+                selfSamples[name]++;
+            }
+        }
+        stacks[stack]++;
+    }
+
+    std::ofstream output_file(filePath);
+    if (!output_file.is_open()) {
+        std::cerr << "Failed to open file for writing: " << filePath << std::endl;
+        return;
+    }
+    for (const auto& stack : stacks) {
+        output_file << stack.first << " " << stack.second << "\n";
+    }
     output_file.close();
 
-    Profiler::get().clear();
+    // The kernel checks CPU timers on its tick, so the rate is at most CONFIG_HZ whatever PROFILE_SAMPLE_HZ is
+    std::cout << "Sampled " << sample_count() << " stacks in " << std::fixed << std::setprecision(3) << cpuSeconds_
+              << " s of CPU time (" << std::setprecision(0) << static_cast<f64>(next_) / std::max(cpuSeconds_, 1e-9)
+              << " Hz, PROFILE_SAMPLE_HZ " << PROFILE_SAMPLE_HZ << ")" << std::defaultfloat << std::setprecision(6);
+    if (dropped_count()) {
+        std::cout << " (" << dropped_count() << " dropped, past PROFILE_MAX_SAMPLES)";
+    }
+    std::cout << ", written to " << filePath << std::endl;
+    vector<std::pair<string, u64>> hottest(selfSamples.begin(), selfSamples.end());
+    std::sort(hottest.begin(), hottest.end(), [](const std::pair<string, u64>& a, const std::pair<string, u64>& b) {
+        return a.second > b.second;
+    });
+    hottest.resize(std::min<size_t>(hottest.size(), 10));
+    char line[256];
+    for (const auto& function : hottest) {
+        snprintf(line, sizeof(line), "  %8llu %6.2f%%  %.200s", static_cast<unsigned long long>(function.second),
+                 100.0 * static_cast<f64>(function.second) / static_cast<f64>(sample_count()), function.first.c_str());
+        std::cout << line << std::endl;
+    }
+}
+#endif
+
+inline ProfilerSession::ProfilerSession(const string& name, const string& filePath) :
+    name_(name),
+    filePath_(filePath),
+    startTicks_(read_profile_timer()),
+    startOSTime_(ReadOSTimer()) {
+#if PROFILE_STREAM_TRACE && !PROFILING_ZONES
+    traceWriter_ = std::make_unique<ProfileTraceWriter>(filePath_ + ".trace", name_, startTicks_);
+#endif
+#if PROFILE_SAMPLING
+    ProfileSampler::get().start();
+#endif
+}
+
+inline ProfilerSession::~ProfilerSession() {
+#if PROFILE_SAMPLING
+    ProfileSampler::get().stop();
+#endif
+#if PROFILING_ZONES
+    u64 totalTicks = read_profile_timer() - startTicks_;
+    std::cout << "Profile \"" << name_ << "\":" << std::endl;
+    Profiler::get().print_zones(totalTicks, cpu_timer_freq_());
+#else
+    if (traceWriter_) {
+        traceWriter_->finish(read_profile_timer(), cpu_timer_freq_());
+    } else {
+        write_profile_results_();
+    }
+    if (u64 allocated = Profiler::get().allocated_chunks()) {
+        std::cout << "Profile \"" << name_ << "\": " << allocated
+                  << " event chunks allocated while recording, past PROFILE_PREALLOCATED_CHUNKS" << std::endl;
+    }
+#endif
+#if PROFILE_SAMPLING
+    ProfileSampler::get().write_folded(filePath_ + ".folded");
+#endif
+}
+
+inline f64 ProfilerSession::cpu_timer_freq_() const {
+    u64 elapsedTicks = read_profile_timer() - startTicks_;
+    u64 elapsedOSTime = ReadOSTimer() - startOSTime_;
+    // Below 100ms the OS timer's microseconds are too coarse to calibrate against
+    if (elapsedOSTime < GetOSTimerFreq() / 10) {
+        return static_cast<f64>(EstimateCPUTimerFreq());
+    }
+    return static_cast<f64>(GetOSTimerFreq()) * static_cast<f64>(elapsedTicks) / static_cast<f64>(elapsedOSTime);
+}
+
+inline void ProfilerSession::write_profile_results_() {
+    f64 cpuTimerFreq = cpu_timer_freq_();
+
+    std::ofstream output_file(filePath_);
+    if (!output_file.is_open()) {
+        std::cerr << "Failed to open file for writing: " << filePath_ << std::endl;
+        return;
+    }
+
+    write_chrome_trace(output_file, name_, static_cast<u64>(std::time(nullptr)), Profiler::get().collect(),
+                       startTicks_, cpuTimerFreq, Profiler::get().available_perf_counters());
+    output_file.close();
 }
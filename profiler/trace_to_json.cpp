@@ -0,0 +1,110 @@
+// Converts a binary trace, written by a session built with -DPROFILE_STREAM_TRACE=1, to the
+// Chrome trace JSON a session writes otherwise (chrome://tracing, Perfetto).
+// A trace cut short (no end record, the program did not end its session) is still converted, with
+// the CPU timer frequency estimated here, which is only right on the machine that recorded it.
+// Traces with hardware event counters (PROFILE_PERF_COUNTERS) get them, and the IPC, as event args.
+//
+// g++ -O2 -o trace_to_json profiler/trace_to_json.cpp -pthread
+// ./trace_to_json profile_results.json.trace [profile_results.json]
+#include <deque>
+// Only for the counters in ProfileResult, so traces recorded with or without them can be read
+#define PROFILE_PERF_COUNTERS 1
+#include "Profiler.h"
+
+// Longer than any name a trace holds (scope names, and the session's name); a longer one is corrupt
+constexpr u64 MAX_NAME_LENGTH = 1 << 20;
+
+int main(int argc, char** argv) {
+    if (argc != 2 && argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <trace_file> [json_file]" << std::endl;
+        return 1;
+    }
+    string tracePath = argv[1];
+    string jsonPath;
+    if (argc == 3) {
+        jsonPath = argv[2];
+    } else if (tracePath.size() > 6 && tracePath.compare(tracePath.size() - 6, 6, ".trace") == 0) {
+        jsonPath = tracePath.substr(0, tracePath.size() - 6);
+    } else {
+        jsonPath = tracePath + ".json";
+    }
+
+    FILE* file = fopen(tracePath.c_str(), "rb");
+    if (!file) {
+        std::cerr << "Failed to open file for reading: " << tracePath << std::endl;
+        return 1;
+    }
+    ProfileTraceHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, PROFILE_TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != PROFILE_TRACE_VERSION || (header.recordSize != sizeof(ProfileTraceRecord) &&
+                                                    header.recordSize != PROFILE_TRACE_RECORD_SIZE)) {
+        std::cerr << tracePath << " is not a binary trace (version " << PROFILE_TRACE_VERSION << ")" << std::endl;
+        fclose(file);
+        return 1;
+    }
+
+    // Names by index, the results point into them
+    std::deque<string> nameStorage;
+    vector<const char*> names;
+    vector<ProfileResult> results;
+    f64 cpuTimerFreq = 0;
+    u32 counters = 0;
+    bool truncated = true;
+    ProfileTraceRecord record;
+    u64 recordCounters[PROFILE_COUNTER_COUNT] = {};
+    size_t counterBytes = header.recordSize - sizeof(record);
+    while (truncated && fread(&record, sizeof(record), 1, file) == 1 &&
+           fread(recordCounters, 1, counterBytes, file) == counterBytes) {
+        if (record.tag == PROFILE_TRACE_NAME) {
+            // The writer gives names the next index, and they are scope names or the session's name
+            if (record.threadID != names.size() || record.start > MAX_NAME_LENGTH) {
+                std::cerr << tracePath << ": name record out of sequence or too long, the trace is corrupt" << std::endl;
+                fclose(file);
+                return 1;
+            }
+            size_t padded = (record.start + header.recordSize - 1) / header.recordSize * header.recordSize;
+            string name(padded, '\0');
+            if (fread(&name[0], 1, padded, file) != padded) {
+                break;
+            }
+            name.resize(record.start);
+            nameStorage.push_back(name);
+            names.push_back(nameStorage.back().c_str());
+        } else if (record.tag == PROFILE_TRACE_END) {
+            memcpy(&cpuTimerFreq, &record.bytes, sizeof(cpuTimerFreq));
+            counters = counterBytes ? record.threadID : 0;
+            truncated = false;
+        } else if (record.tag < names.size()) {
+            ProfileResult& result = results.emplace_back();
+            result.name = names[record.tag];
+            result.start = record.start;
+            result.end = record.end;
+            result.bytes = record.bytes;
+            result.ThreadID = record.threadID;
+            memcpy(result.counters, recordCounters, sizeof(recordCounters));
+        } else {
+            std::cerr << tracePath << ": event with an unknown name, the trace is corrupt" << std::endl;
+            fclose(file);
+            return 1;
+        }
+    }
+    fclose(file);
+    if (truncated) {
+        cpuTimerFreq = static_cast<f64>(EstimateCPUTimerFreq());
+        std::cerr << tracePath << " has no end record (the session did not end), using the CPU timer frequency measured now" << std::endl;
+    }
+
+    std::stable_sort(results.begin(), results.end(), [](const ProfileResult& a, const ProfileResult& b) {
+        return a.start < b.start;
+    });
+    std::ofstream output_file(jsonPath);
+    if (!output_file.is_open()) {
+        std::cerr << "Failed to open file for writing: " << jsonPath << std::endl;
+        return 1;
+    }
+    write_chrome_trace(output_file, names.empty() ? "" : names[0], header.timestamp, results, header.startTicks,
+                       cpuTimerFreq, counters);
+    output_file.close();
+    std::cout << "Wrote " << results.size() << " events to " << jsonPath << std::endl;
+    return 0;
+}
@@ -0,0 +1,197 @@
+// Checks that ParallelParser gives exactly the document the serial Parser gives, with 1 to 8
+// threads, on inputs made to fool its guesses of where array elements start: elements with
+// nested arrays of objects that start with the same key, strings holding "},{", "{", "],[" and
+// ", ", arrays of arrays, a root object holding several large arrays, and inputs with syntax
+// errors (which must throw the same error as Parser). Each input is a few MB, so the arrays are
+// really split (ParallelParser::MIN_CHUNK_BYTES is 1 MB).
+//
+// g++ -O2 -o parallel_test tests/parallel_test.cpp json/json_parallel.cpp json/json_parser.cpp json/json_structural.cpp json/json_number.cpp json/json_input.cpp json/json_object.cpp -pthread
+// ./parallel_test
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../json/json_parallel.hpp"
+
+#define MaxThreads 8
+
+static unsigned long long RandomState = 0x9E3779B97F4A7C15ULL;
+static unsigned long long NextRandom(void) {
+    RandomState ^= RandomState >> 12;
+    RandomState ^= RandomState << 25;
+    RandomState ^= RandomState >> 27;
+    return RandomState * 2685821657736338717ULL;
+}
+
+static std::string RandomNumber(void) {
+    char Text[64];
+    snprintf(Text, sizeof(Text), "%.16f", -180.0 + 360.0 * ((double)(NextRandom() >> 11) / (double)(1ULL << 53)));
+    return Text;
+}
+
+// An array of at least Bytes bytes, of the elements Element makes separated by Separator
+template <typename F>
+static std::string Array(size_t Bytes, char const *Separator, F &&Element) {
+    std::string Result = "[";
+    for (size_t Index = 0; Result.size() < Bytes; ++Index){
+        if (Index){
+            Result += Separator;
+        }
+        Result += Element();
+    }
+    Result += "]";
+    return Result;
+}
+
+static bool Equal(JsonValue const &A, JsonValue const &B) {
+    if (A.isObject() && B.isObject()){
+        JsonObject const &ObjectA = A.asObject();
+        JsonObject const &ObjectB = B.asObject();
+        if (ObjectA.size() != ObjectB.size()){
+            return false;
+        }
+        // Same members in the same order
+        JsonObject::iterator MemberB = ObjectB.begin();
+        for (JsonObject::Member MemberA : ObjectA){
+            if (MemberA.key != (*MemberB).key || !Equal(MemberA.value, (*MemberB).value)){
+                return false;
+            }
+            ++MemberB;
+        }
+        return true;
+    }
+    if (A.isArray() && B.isArray()){
+        JsonArray const &ArrayA = A.asArray();
+        JsonArray const &ArrayB = B.asArray();
+        if (ArrayA.size() != ArrayB.size()){
+            return false;
+        }
+        for (size_t Index = 0; Index < ArrayA.size(); ++Index){
+            if (!Equal(ArrayA[Index], ArrayB[Index])){
+                return false;
+            }
+        }
+        return true;
+    }
+    if (A.isString() && B.isString()) return A.asString() == B.asString();
+    if (A.isNumber() && B.isNumber()){
+        // Bit for bit
+        double NumberA = A.asNumber();
+        double NumberB = B.asNumber();
+        return memcmp(&NumberA, &NumberB, sizeof(NumberA)) == 0;
+    }
+    if (A.isBool() && B.isBool()) return A.asBool() == B.asBool();
+    return A.isNull() && B.isNull();
+}
+
+struct test_input {
+    char const *Name;
+    std::string Text;
+};
+
+static std::vector<test_input> BuildInputs(void) {
+    std::vector<test_input> Inputs;
+    size_t Bytes = 3 << 20;
+
+    Inputs.push_back({"pairs", "{\"pairs\":" + Array(Bytes, ",\n", []{
+        return "{\"x0\":" + RandomNumber() + ",\"y0\":" + RandomNumber() + ",\"x1\":" + RandomNumber() + ",\"y1\":" + RandomNumber() + "}";
+    }) + "}"});
+
+    // Every element holds "},{"x0": of its own, a guess can land inside an element
+    Inputs.push_back({"nested same key", Array(Bytes, ",", []{
+        std::string Element = "{\"x0\":" + RandomNumber() + ",\"kids\":[";
+        size_t Count = 1 + NextRandom() % 4;
+        for (size_t Index = 0; Index < Count; ++Index){
+            Element += std::string(Index ? "},{" : "{") + "\"x0\":" + RandomNumber() + ",\"y0\":[{\"x0\":1},{\"x0\":2}]";
+        }
+        return Element + "}]}";
+    })});
+
+    // Strings that look like element boundaries
+    Inputs.push_back({"boundaries in strings", Array(Bytes, ", ", []{
+        static char const *Strings[] = {"\"},{\"", "\"},\"", "\"{\"", "\"],[\"", "\", \"", "\"},{x0:\"", "\"}, {\"",};
+        std::string Element = "{\"x0\":";
+        Element += Strings[NextRandom() % 7];
+        Element += ",\"s\":";
+        Element += Strings[NextRandom() % 7];
+        return Element + ",\"n\":" + RandomNumber() + "}";
+    })});
+
+    // Scalars are split at any ',' followed by a value, strings with ", " fool that
+    Inputs.push_back({"strings with commas", Array(Bytes, ",", []{
+        static char const *Strings[] = {"\"a, b\"", "\"1,2\"", "\", x\"", "\"{, [\"", "\",\"", "\"]\"",};
+        return (NextRandom() % 3) ? std::string(Strings[NextRandom() % 6]) : RandomNumber();
+    })});
+
+    Inputs.push_back({"arrays of arrays", Array(Bytes, ",", []{
+        std::string Element = "[" + RandomNumber();
+        if (NextRandom() % 2){
+            Element += ",[" + RandomNumber() + "],[[" + RandomNumber() + "],[\"],[\"]]";
+        }
+        return Element + "]";
+    })});
+
+    Inputs.push_back({"pretty printed", "{\n  \"pairs\": " + Array(Bytes, " ,\n    ", []{
+        return "{\n      \"x0\" : " + RandomNumber() + ",\n      \"y0\" : " + RandomNumber() + "\n    }";
+    }) + "\n}\n"});
+
+    // Several large arrays in one root object, and members that are not arrays around them
+    std::string Objects = Array(Bytes / 2, ",", []{ return "{\"x0\":" + RandomNumber() + ",\"y\":[1,{\"x0\":2}]}"; });
+    std::string Numbers = Array(Bytes / 2, ",", []{ return RandomNumber(); });
+    Inputs.push_back({"root object", "{\"name\":\"pairs\",\"a\":" + Objects + ",\"n\":3,\"b\":" + Numbers +
+                                     ",\"c\":{\"d\":[]},\"e\":" + Objects + "}"});
+
+    // Errors, where the serial parser throws: in the middle of a chunk, at the end, past the end
+    std::string Pairs = Inputs[0].Text;
+    std::string Broken = Pairs;
+    Broken.insert(Broken.size() / 2 + 17, "}");
+    Inputs.push_back({"error in the middle", Broken});
+    Inputs.push_back({"missing closing bracket", Pairs.substr(0, Pairs.size() - 2) + "}"});
+    Inputs.push_back({"truncated", Pairs.substr(0, Pairs.size() - 1000)});
+    Inputs.push_back({"trailing characters", Pairs + " ,"});
+    Inputs.push_back({"second root value", Inputs[4].Text + " []"});
+    return Inputs;
+}
+
+int main(void) {
+    std::vector<test_input> Inputs = BuildInputs();
+    int Failures = 0;
+    for (test_input const &Input : Inputs){
+        JsonValue Expected;
+        std::string ExpectedError;
+        try {
+            Lexer Tokens(Input.Text);
+            Parser Serial(Tokens);
+            Expected = Serial.parse();
+        } catch (std::exception const &Error) {
+            ExpectedError = Error.what();
+        }
+
+        printf("%-24s %5.1f MB, chunks used with 1..%d threads:", Input.Name, (double)Input.Text.size() / (1 << 20), MaxThreads);
+        for (unsigned ThreadCount = 1; ThreadCount <= MaxThreads; ++ThreadCount){
+            ParallelParser Parallel(Input.Text, ThreadCount);
+            JsonValue Actual;
+            std::string ActualError;
+            try {
+                Actual = Parallel.parse();
+            } catch (std::exception const &Error) {
+                ActualError = Error.what();
+            }
+            printf(" %zu", Parallel.chunkCount());
+
+            bool Same = ExpectedError.empty() ? (ActualError.empty() && Equal(Expected, Actual)) : (ActualError == ExpectedError);
+            if (!Same){
+                ++Failures;
+                printf(" (FAIL with %u threads: %s)", ThreadCount,
+                       ActualError.empty() ? (ExpectedError.empty() ? "different document" : "no error") : ActualError.c_str());
+            }
+        }
+        printf(ExpectedError.empty() ? "\n" : " (error: %s)\n", ExpectedError.c_str());
+    }
+    if (Failures){
+        printf("%d parses differ from Parser\n", Failures);
+        return 1;
+    }
+    printf("ParallelParser gives the same result as Parser with every thread count\n");
+    return 0;
+}
@@ -0,0 +1,206 @@
+// Checks that the structural index changes nothing about the tokens: every input is tokenized with
+// StructuralBackend::NONE (byte by byte) and with each SIMD backend the CPU supports, and the
+// (type, value, offset) sequences must be identical. The inputs cover strings with escapes and
+// with structural characters inside, whitespace runs of every length up to a few blocks, and
+// tokens and whitespace runs straddling the 64 byte blocks and the 16 KB STRUCTURAL_WINDOW edges.
+//
+// g++ -O2 -o structural_test tests/structural_test.cpp json/json_parser.cpp json/json_structural.cpp json/json_number.cpp json/json_input.cpp json/json_object.cpp -pthread
+// ./structural_test
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "../json/json_parser.hpp"
+
+// Same as STRUCTURAL_WINDOW in json_parser.cpp
+#define StructuralWindow (16 * 1024)
+
+struct token_record {
+    TokenType Type;
+    std::string_view Value;
+    size_t Offset;
+
+    bool operator==(token_record const &Other) const {
+        return Type == Other.Type && Value == Other.Value && Offset == Other.Offset;
+    }
+};
+
+static unsigned long long RandomState = 0x9E3779B97F4A7C15ULL;
+static unsigned long long NextRandom(void) {
+    RandomState ^= RandomState >> 12;
+    RandomState ^= RandomState << 25;
+    RandomState ^= RandomState >> 27;
+    return RandomState * 2685821657736338717ULL;
+}
+
+static std::vector<token_record> Tokenize(std::string const &Input, StructuralBackend Backend) {
+    std::vector<token_record> Result;
+    Lexer Tokens(Input, Backend);
+    while (true){
+        Token Next = Tokens.getNextToken();
+        Result.push_back({Next.type, Next.value, (size_t)(Next.value.data() - Input.data())});
+        // An unknown character is not consumed, the parser stops there
+        if (Next.type == TokenType::EOF_T || Next.type == TokenType::UNK){
+            break;
+        }
+    }
+    return Result;
+}
+
+static std::string Whitespace(size_t Length) {
+    static char const Characters[] = {' ', '\t', '\n', '\r'};
+    std::string Result;
+    for (size_t Index = 0; Index < Length; ++Index){
+        Result += Characters[NextRandom() % 4];
+    }
+    return Result;
+}
+
+// Whitespace runs are mostly short, sometimes long enough to cover whole 64 byte blocks
+static std::string RandomWhitespace(void) {
+    unsigned long long Kind = NextRandom() % 8;
+    size_t Length = (Kind < 4) ? 0 : (Kind < 7) ? NextRandom() % 8 : NextRandom() % 200;
+    return Whitespace(Length);
+}
+
+static std::string RandomScalar(void) {
+    // Escapes other than \" (which the lexer does not support), and structural characters in strings
+    static char const *Strings[] = {
+        "\"\"", "\"x0\"", "\"a b\"", "\"line\\nbreak\"", "\"tab\\there\"", "\"back\\\\slash\"", "\"\\u00e9t\\u00e9\"",
+        "\"{\\\\\"", "\"},{\"", "\"[1, 2]: ,\"", "\"   \"", "\"\\/\\b\\f\\r\"",
+    };
+    static char const *Others[] = {
+        "0", "-1", "3.25", "-0.5e-3", "1E+10", "102.6591234567890123", "true", "false", "null",
+    };
+    if (NextRandom() % 2){
+        return Strings[NextRandom() % (sizeof(Strings) / sizeof(Strings[0]))];
+    }
+    return Others[NextRandom() % (sizeof(Others) / sizeof(Others[0]))];
+}
+
+static void AppendValue(std::string &Out, int Depth) {
+    unsigned long long Kind = (Depth > 3) ? 2 : NextRandom() % 3;
+    if (Kind == 0){
+        Out += "{" + RandomWhitespace();
+        size_t Count = NextRandom() % 5;
+        for (size_t Index = 0; Index < Count; ++Index){
+            if (Index){
+                Out += "," + RandomWhitespace();
+            }
+            Out += RandomScalar() + RandomWhitespace() + ":" + RandomWhitespace();
+            AppendValue(Out, Depth + 1);
+            Out += RandomWhitespace();
+        }
+        Out += "}";
+    } else if (Kind == 1){
+        Out += "[" + RandomWhitespace();
+        size_t Count = NextRandom() % 6;
+        for (size_t Index = 0; Index < Count; ++Index){
+            if (Index){
+                Out += RandomWhitespace() + "," + RandomWhitespace();
+            }
+            AppendValue(Out, Depth + 1);
+        }
+        Out += RandomWhitespace() + "]";
+    } else {
+        Out += RandomScalar();
+    }
+}
+
+static std::string RandomDocument(size_t MinLength) {
+    std::string Result = "[" + RandomWhitespace();
+    while (Result.size() < MinLength){
+        AppendValue(Result, 0);
+        Result += RandomWhitespace() + "," + RandomWhitespace();
+    }
+    Result += "null" + RandomWhitespace() + "]" + RandomWhitespace();
+    return Result;
+}
+
+// Pads in front of Token so that it starts Shift bytes before the window edge at Edge
+static std::string AcrossEdge(std::string const &Token, size_t Edge, size_t Shift) {
+    std::string Result = "[";
+    while (Result.size() + 8 < Edge - Shift){
+        Result += "1,";
+        Result += Whitespace(NextRandom() % 4);
+    }
+    Result += Whitespace(Edge - Shift - Result.size());
+    Result += Token + Whitespace(NextRandom() % 3) + "]";
+    return Result;
+}
+
+static std::vector<std::string> BuildInputs(void) {
+    std::vector<std::string> Inputs = {
+        "", " ", "{}", "[]", "\"\"", "  \t\n\r  ", "[\"a\\\\\",\"b\"]", "{\"key\" : \"value , with } inside\"}",
+        "[1,2,3]", "[ 1 , 2 , 3 ]", "true false null", "[tru, nul]",
+    };
+    // Whitespace runs of every length, to hit each position in a block and whole blocks
+    for (size_t Length = 0; Length < 200; ++Length){
+        Inputs.push_back("[1," + Whitespace(Length) + "\"s\"," + Whitespace(Length) + "2]");
+    }
+    // Strings, numbers, keywords and whitespace runs across the first and second window edges
+    char const *EdgeTokens[] = {
+        "\"a string across the window edge\"", "\"esc\\\\ape\\n\\t\\u0041\"", "\"{[:,]}\"", "-123.456e-7", "false",
+        "                                                                                                    \"s\"",
+    };
+    for (size_t Edge : {(size_t)StructuralWindow, (size_t)2*StructuralWindow}){
+        for (char const *Token : EdgeTokens){
+            for (size_t Shift = 1; Shift < 100; Shift += 3){
+                Inputs.push_back(AcrossEdge(Token, Edge, Shift));
+            }
+        }
+    }
+    // Larger random documents, several windows long
+    for (int Index = 0; Index < 20; ++Index){
+        Inputs.push_back(RandomDocument(1000 + NextRandom() % (5*StructuralWindow)));
+    }
+    return Inputs;
+}
+
+static char const *BackendName(StructuralBackend Backend) {
+    switch (Backend){
+        case StructuralBackend::SCALAR: return "scalar";
+        case StructuralBackend::SSE2: return "SSE2";
+        case StructuralBackend::AVX2: return "AVX2";
+        default: return "?";
+    }
+}
+
+int main(void) {
+    std::vector<std::string> Inputs = BuildInputs();
+    int Failures = 0;
+    StructuralBackend Backends[] = {StructuralBackend::SCALAR, StructuralBackend::SSE2, StructuralBackend::AVX2};
+    for (StructuralBackend Backend : Backends){
+        // The indexer falls back when the CPU lacks the instructions, there is no point testing it twice
+        if (StructuralIndexer(Backend).backend() != Backend){
+            printf("%-6s not supported by this CPU, skipped\n", BackendName(Backend));
+            continue;
+        }
+        size_t TokenCount = 0;
+        for (size_t Index = 0; Index < Inputs.size(); ++Index){
+            std::vector<token_record> Expected = Tokenize(Inputs[Index], StructuralBackend::NONE);
+            std::vector<token_record> Actual = Tokenize(Inputs[Index], Backend);
+            TokenCount += Expected.size();
+            if (Expected == Actual){
+                continue;
+            }
+            ++Failures;
+            size_t First = 0;
+            while (First < Expected.size() && First < Actual.size() && Expected[First] == Actual[First]){
+                ++First;
+            }
+            printf("FAIL %s, input %zu (%zu bytes): %zu tokens byte by byte, %zu indexed, first difference at token %zu",
+                   BackendName(Backend), Index, Inputs[Index].size(), Expected.size(), Actual.size(), First);
+            if (First < Expected.size() && First < Actual.size()){
+                printf(" (offset %zu vs %zu)", Expected[First].Offset, Actual[First].Offset);
+            }
+            printf("\n");
+        }
+        printf("%-6s %zu inputs, %zu tokens\n", BackendName(Backend), Inputs.size(), TokenCount);
+    }
+    if (Failures){
+        printf("%d inputs tokenized differently\n", Failures);
+        return 1;
+    }
+    printf("All backends give the same tokens as the byte by byte lexer\n");
+    return 0;
+}
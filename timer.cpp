@@ -1,4 +1,5 @@
 // Measuring CPU frequency by comparing the Time Stamp Counter (TSC) against a known time reference.
+#pragma once
 #include <x86intrin.h>
 #include <sys/time.h>
 #include <stdint.h>
@@ -25,6 +26,14 @@ inline u64 ReadCPUTimer(void) {
     return __rdtsc();
 }
 
+// Same, with fences so the read is not reordered with the instructions before or after it
+inline u64 ReadCPUTimerSerialized(void) {
+    _mm_lfence();
+    u64 result = __rdtsc();
+    _mm_lfence();
+    return result;
+}
+
 static u64 EstimateCPUTimerFreq(void) {
 	u64 MillisecondsToWait = 100;
 	u64 OSFreq = GetOSTimerFreq();